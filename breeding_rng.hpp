@@ -0,0 +1,28 @@
+#ifndef BREEDING_RNG_HPP
+#define BREEDING_RNG_HPP
+
+#include <stdint.h>
+#include <random>
+
+// Random numbers for breeding: selection, crossover, EAX and mutation all
+// draw from one generator per thread, so workers never contend on the
+// lock inside rand().
+static inline std::mt19937 &breeding_rng()
+{
+    static thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+// Restarts the calling thread's generator, for runs that must repeat.
+static inline void seed_breeding_rng(uint32_t seed)
+{
+    breeding_rng().seed(seed);
+}
+
+// Uniform in 0..bound - 1, as rand() % bound was.
+static inline int random_below(int bound)
+{
+    return breeding_rng()() % (uint32_t)bound;
+}
+
+#endif
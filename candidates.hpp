@@ -0,0 +1,267 @@
+#ifndef CANDIDATES_HPP
+#define CANDIDATES_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "tsp_loader.hpp"
+#include "dist_matrix.hpp"
+
+static const int quadrant_neighbors = 2;
+
+// Candidate edges per city, nearest first, in one CSR array: the candidates of
+// city i (0-based) are list[offset[i]..offset[i + 1]). Operators that only try
+// these edges do work proportional to k per city instead of to N.
+class CandidateLists
+{
+public:
+    CandidateLists() : n(0), k(0)
+    {
+    }
+
+    CandidateLists(int n, int k) : n(n), k(k), offset(n + 1, 0)
+    {
+    }
+
+    inline const int32_t *begin(int i) const
+    {
+        return list.data() + offset[i];
+    }
+
+    inline const int32_t *end(int i) const
+    {
+        return list.data() + offset[i + 1];
+    }
+
+    inline int count(int i) const
+    {
+        return offset[i + 1] - offset[i];
+    }
+
+    int size() const
+    {
+        return n;
+    }
+
+    // The k the lists were built with; 0 when there are none.
+    int nearest() const
+    {
+        return k;
+    }
+
+    size_t bytes() const
+    {
+        return offset.size() * sizeof(int32_t) + list.size() * sizeof(int32_t);
+    }
+
+    int n;
+    int k;
+    std::vector<int32_t> offset;
+    std::vector<int32_t> list;
+};
+
+// Uniform grid over the bounding box with about two cities per cell; the
+// cities of cell c are city[start[c]..start[c + 1]).
+struct CandidateGrid
+{
+    CandidateGrid(const TspInstance &instance) : x(instance.x.data()), y(instance.y.data())
+    {
+        int n = instance.dimension;
+        min_x = max_x = x[0];
+        min_y = max_y = y[0];
+        for (int i = 1; i < n; i++)
+        {
+            min_x = std::min(min_x, x[i]);
+            max_x = std::max(max_x, x[i]);
+            min_y = std::min(min_y, y[i]);
+            max_y = std::max(max_y, y[i]);
+        }
+        side = std::max(1, (int)sqrt(n / 2.0));
+        double extent = std::max(max_x - min_x, max_y - min_y);
+        width = extent > 0 ? extent / side : 1;
+        std::vector<int> cell(n);
+        start.assign((size_t)side * side + 1, 0);
+        for (int i = 0; i < n; i++)
+        {
+            cell[i] = cell_y(y[i]) * side + cell_x(x[i]);
+            start[cell[i] + 1]++;
+        }
+        for (size_t c = 0; c < (size_t)side * side; c++)
+            start[c + 1] += start[c];
+        city.resize(n);
+        std::vector<int> fill(start.begin(), start.end() - 1);
+        for (int i = 0; i < n; i++)
+            city[fill[cell[i]]++] = i;
+    }
+
+    inline int cell_x(double v) const
+    {
+        return std::min(side - 1, (int)((v - min_x) / width));
+    }
+
+    inline int cell_y(double v) const
+    {
+        return std::min(side - 1, (int)((v - min_y) / width));
+    }
+
+    const double *x;
+    const double *y;
+    double min_x, max_x, min_y, max_y, width;
+    int side;
+    std::vector<int> start;
+    std::vector<int> city;
+};
+
+typedef std::pair<double, int> Candidate;
+
+// Keeps the m nearest offers in a max-heap.
+static inline void candidate_offer(std::vector<Candidate> &heap, size_t m, double d, int j)
+{
+    if (heap.size() < m)
+    {
+        heap.push_back({d, j});
+        std::push_heap(heap.begin(), heap.end());
+    }
+    else if (d < heap.front().first)
+    {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {d, j};
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+// k nearest cities of i plus the quadrant_neighbors nearest in each quadrant
+// around it, so clustered instances keep edges between clusters. Rings of
+// cells are visited outwards until no unvisited cell can hold a closer
+// city; quadrants are searched up to three times the radius that settled the
+// k nearest. Distances are Euclidean on the file coordinates.
+static int grid_candidates(const CandidateGrid &grid, int i, int k, int32_t *out)
+{
+    std::vector<Candidate> nearest;
+    std::vector<Candidate> quadrant[4];
+    nearest.reserve(k + 1);
+    double xi = grid.x[i], yi = grid.y[i];
+    int cx = grid.cell_x(xi), cy = grid.cell_y(yi);
+    int settled = -1;
+    for (int r = 0; r < grid.side; r++)
+    {
+        for (int gy = cy - r; gy <= cy + r; gy++)
+        {
+            if (gy < 0 || gy >= grid.side)
+                continue;
+            int step = gy == cy - r || gy == cy + r ? 1 : 2 * r;
+            for (int gx = cx - r; gx <= cx + r; gx += step)
+            {
+                if (gx < 0 || gx >= grid.side)
+                    continue;
+                int c = gy * grid.side + gx;
+                for (int s = grid.start[c]; s < grid.start[c + 1]; s++)
+                {
+                    int j = grid.city[s];
+                    if (j == i)
+                        continue;
+                    double dx = grid.x[j] - xi, dy = grid.y[j] - yi;
+                    double d = dx * dx + dy * dy;
+                    if (settled < 0)
+                        candidate_offer(nearest, k, d, j);
+                    candidate_offer(quadrant[(dx < 0) + 2 * (dy < 0)], quadrant_neighbors, d, j);
+                }
+            }
+        }
+        double reach = r * grid.width;
+        if (settled < 0 && (int)nearest.size() == k && nearest.front().first <= reach * reach)
+            settled = r;
+        bool quadrants_full = true;
+        for (auto &q : quadrant)
+            quadrants_full = quadrants_full && q.size() == (size_t)quadrant_neighbors && q.front().first <= reach * reach;
+        if (settled >= 0 && (quadrants_full || r >= 3 * settled + 1))
+            break;
+    }
+    for (auto &q : quadrant)
+    {
+        for (const Candidate &c : q)
+        {
+            bool seen = false;
+            for (const Candidate &m : nearest)
+                seen = seen || m.second == c.second;
+            if (!seen)
+                nearest.push_back(c);
+        }
+    }
+    std::sort(nearest.begin(), nearest.end());
+    for (size_t m = 0; m < nearest.size(); m++)
+        out[m] = nearest[m].second;
+    return nearest.size();
+}
+
+// k nearest cities of i by the EXPLICIT weights.
+static int weight_candidates(const ExplicitWeights &weights, int n, int i, int k, int32_t *out)
+{
+    std::vector<Candidate> row;
+    row.reserve(n - 1);
+    for (int j = 0; j < n; j++)
+    {
+        if (j != i)
+            row.push_back({(double)weights(i, j), j});
+    }
+    int m = std::min(k, n - 1);
+    std::partial_sort(row.begin(), row.begin() + m, row.end());
+    for (int c = 0; c < m; c++)
+        out[c] = row[c].second;
+    return m;
+}
+
+// Runs fill(i, out) for every city on nw threads, each over a contiguous
+// block of cities, and packs the results into lists.
+template <typename Fill>
+static void candidate_threads(CandidateLists &lists, int slots, int nw, Fill fill)
+{
+    int n = lists.n;
+    std::vector<int32_t> all((size_t)n * slots);
+    std::vector<int> counts(n);
+    int nt = std::max(1, std::min(nw, n / 256));
+    auto work = [&](int t)
+    {
+        for (int i = (long)n * t / nt; i < (long)n * (t + 1) / nt; i++)
+            counts[i] = fill(i, &all[(size_t)i * slots]);
+    };
+    std::vector<std::thread> builders;
+    for (int t = 1; t < nt; t++)
+        builders.push_back(std::thread(work, t));
+    work(0);
+    for (auto &t : builders)
+        t.join();
+    for (int i = 0; i < n; i++)
+        lists.offset[i + 1] = lists.offset[i] + counts[i];
+    lists.list.resize(lists.offset[n]);
+    for (int i = 0; i < n; i++)
+        std::copy(&all[(size_t)i * slots], &all[(size_t)i * slots] + counts[i], &lists.list[lists.offset[i]]);
+}
+
+// Builds the k-nearest candidate lists with nw threads: from a uniform grid
+// for coordinate instances, from the weight rows for EXPLICIT ones. k = 0
+// leaves them empty.
+static CandidateLists build_candidates(const TspInstance &instance, int k, int nw)
+{
+    int n = instance.dimension;
+    if (k <= 0 || n < 2)
+        return CandidateLists();
+    CandidateLists lists(n, k);
+    if (!instance.x.empty())
+    {
+        CandidateGrid grid(instance);
+        candidate_threads(lists, k + 4 * quadrant_neighbors, nw, [&](int i, int32_t *out)
+                          { return grid_candidates(grid, i, k, out); });
+    }
+    else
+    {
+        ExplicitWeights weights(instance);
+        candidate_threads(lists, k, nw, [&](int i, int32_t *out)
+                          { return weight_candidates(weights, n, i, k, out); });
+    }
+    return lists;
+}
+
+#endif
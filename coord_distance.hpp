@@ -0,0 +1,142 @@
+#ifndef COORD_DISTANCE_HPP
+#define COORD_DISTANCE_HPP
+
+#include <string.h>
+#include <type_traits>
+#include "tsp_loader.hpp"
+#include "dist_matrix.hpp"
+#include "dist_kernels.hpp"
+
+static const size_t matrix_max_bytes = (size_t)1 << 30;
+
+// Matrix-free backend: the coordinates are kept in structure-of-arrays form and
+// every distance is computed on demand with Metric, so memory grows linearly
+// with the cities. It is also the source the distance tables are built from.
+template <typename Metric>
+class CoordDistance
+{
+public:
+    typedef int32_t value_type;
+
+    CoordDistance(const TspInstance &instance) : n(instance.dimension)
+    {
+        x = (double *)aligned_block(n * sizeof(double));
+        y = (double *)aligned_block(n * sizeof(double));
+        for (int i = 0; i < n; i++)
+        {
+            x[i] = Metric::coord(instance.x[i]);
+            y[i] = Metric::coord(instance.y[i]);
+        }
+    }
+
+    CoordDistance(CoordDistance &&other) : n(other.n), x(other.x), y(other.y)
+    {
+        other.x = other.y = NULL;
+    }
+
+    CoordDistance(const CoordDistance &) = delete;
+    CoordDistance &operator=(const CoordDistance &) = delete;
+
+    ~CoordDistance()
+    {
+        free(x);
+        free(y);
+    }
+
+    inline int32_t operator()(int i, int j) const
+    {
+        return Metric::distance(x[i], y[i], x[j], y[j]);
+    }
+
+    // out[j - j_begin] = d(i, j) for j in [j_begin, j_end).
+    template <typename T>
+    inline void distances(int i, int j_begin, int j_end, T *out) const
+    {
+        distance_row<Metric>(x + j_begin, y + j_begin, x[i], y[i], out, j_end - j_begin);
+    }
+
+    inline void prefetch(int i, int j) const
+    {
+        __builtin_prefetch(&x[i]);
+        __builtin_prefetch(&y[i]);
+        __builtin_prefetch(&x[j]);
+        __builtin_prefetch(&y[j]);
+    }
+
+    const double *xs() const
+    {
+        return x;
+    }
+
+    const double *ys() const
+    {
+        return y;
+    }
+
+    int size() const
+    {
+        return n;
+    }
+
+    size_t bytes() const
+    {
+        return 2 * n * sizeof(double);
+    }
+
+    // Upper bound on every edge: the distance across the bounding box, or
+    // half the earth's circumference for GEO.
+    double max_edge() const
+    {
+        if (std::is_same<Metric, Geo>::value)
+            return 20038;
+        double min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0];
+        for (int i = 1; i < n; i++)
+        {
+            min_x = x[i] < min_x ? x[i] : min_x;
+            max_x = x[i] > max_x ? x[i] : max_x;
+            min_y = y[i] < min_y ? y[i] : min_y;
+            max_y = y[i] > max_y ? y[i] : max_y;
+        }
+        return Metric::distance(min_x, min_y, max_x, max_y);
+    }
+
+private:
+    int n;
+    double *x;
+    double *y;
+};
+
+// Gathers the tour coordinates block by block and measures each block with
+// the vector kernel; path holds 1-based city ids.
+template <typename Metric, typename Idx>
+static inline length_t tour_length(const CoordDistance<Metric> &dist, const Idx *path, int n)
+{
+    const int block = 256;
+    alignas(32) double bx[block + 1];
+    alignas(32) double by[block + 1];
+    const double *x = dist.xs();
+    const double *y = dist.ys();
+    length_t total = 0;
+    for (int start = 0; start < n; start += block)
+    {
+        int m = n - start < block ? n - start : block;
+        for (int k = 0; k <= m; k++)
+        {
+            int c = path[start + k == n ? 0 : start + k] - 1;
+            bx[k] = x[c];
+            by[k] = y[c];
+        }
+        total += (length_t)edge_sum<Metric>(bx, by, m);
+    }
+    return total;
+}
+
+// "auto" drops the table once even the packed layout would exceed matrix_max_bytes.
+static bool matrix_free(const char *backend, int n)
+{
+    if (strcmp(backend, "auto") == 0)
+        return (size_t)n * (n + 1) / 2 * sizeof(int32_t) > matrix_max_bytes;
+    return strcmp(backend, "coords") == 0;
+}
+
+#endif
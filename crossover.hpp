@@ -0,0 +1,282 @@
+#ifndef CROSSOVER_HPP
+#define CROSSOVER_HPP
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "breeding_rng.hpp"
+
+// Crossover operators on tours of n 1-based city ids. They write the child
+// into its own buffer and leave its length to the caller.
+
+// Which cities the child already holds, as one stamp per city: a city is
+// marked when its stamp equals the current one, so starting the next child
+// costs O(1) instead of clearing n flags.
+class VisitStamps
+{
+public:
+    // Forgets every mark; cities are 1..n.
+    inline void begin(int n)
+    {
+        if ((int)stamp.size() < n + 1)
+            stamp.assign(n + 1, 0);
+        if (++now == 0)
+        {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            now = 1;
+        }
+    }
+
+    inline void mark(uint32_t city)
+    {
+        stamp[city] = now;
+    }
+
+    inline bool marked(uint32_t city) const
+    {
+        return stamp[city] == now;
+    }
+
+private:
+    std::vector<uint32_t> stamp;
+    uint32_t now = 0;
+};
+
+// Scratch space of the operators, one per thread and grown on demand, so
+// breeding a child allocates nothing once the first few are done.
+struct CrossoverScratch
+{
+    VisitStamps held;
+    std::vector<int32_t> position;
+    std::vector<int32_t> adjacency;
+    std::vector<uint8_t> degree;
+    std::vector<int32_t> left;
+    std::vector<int32_t> where;
+
+    // Cities are 1..n, positions 0..n - 1.
+    void reserve(int n)
+    {
+        held.begin(n);
+        if ((int)position.size() < n + 1)
+        {
+            position.resize(n + 1);
+            adjacency.resize((size_t)(n + 1) * 4);
+            degree.resize(n + 1);
+            left.resize(n);
+            where.resize(n + 1);
+        }
+    }
+};
+
+static inline CrossoverScratch &thread_scratch()
+{
+    static thread_local CrossoverScratch scratch;
+    return scratch;
+}
+
+// One-point order crossover: the child keeps first[0..cut) and takes the rest
+// position by position from second; a city it already holds is replaced by
+// the earliest city of second it does not hold yet. The earliest free city
+// only moves forward, so the whole child is O(n).
+template <typename Idx>
+static void order_crossover(const Idx *first, const Idx *second, Idx *child, int n, int cut)
+{
+    CrossoverScratch &scratch = thread_scratch();
+    scratch.reserve(n);
+    VisitStamps &held = scratch.held;
+    for (int k = 0; k < cut; k++)
+    {
+        child[k] = first[k];
+        held.mark(first[k]);
+    }
+    int free = 0;
+    for (int k = cut; k < n; k++)
+    {
+        Idx city = second[k];
+        if (held.marked(city))
+        {
+            while (held.marked(second[free]))
+                free++;
+            city = second[free];
+        }
+        child[k] = city;
+        held.mark(city);
+    }
+}
+
+// OX: order_crossover at a random cut.
+template <typename Idx>
+static void ox_crossover(const Idx *first, const Idx *second, Idx *child, int n)
+{
+    order_crossover(first, second, child, n, random_below(n - 1));
+}
+
+// PMX: the child keeps first in a random segment and takes second elsewhere;
+// a city of second already in the segment is mapped through the segment,
+// first[p] -> second[p], until it leaves it. The mapping chains are disjoint,
+// so all of them together visit each segment position at most once.
+template <typename Idx>
+static void pmx_crossover(const Idx *first, const Idx *second, Idx *child, int n)
+{
+    CrossoverScratch &scratch = thread_scratch();
+    scratch.reserve(n);
+    int a = random_below(n);
+    int b = random_below(n);
+    if (a > b)
+        std::swap(a, b);
+    b++;
+    for (int k = a; k < b; k++)
+    {
+        child[k] = first[k];
+        scratch.held.mark(first[k]);
+        scratch.position[first[k]] = k;
+    }
+    for (int k = 0; k < n; k++)
+    {
+        if (k == a)
+        {
+            k = b - 1;
+            continue;
+        }
+        Idx city = second[k];
+        while (scratch.held.marked(city))
+            city = second[scratch.position[city]];
+        child[k] = city;
+    }
+}
+
+// CX: splits the positions into the cycles of first -> second and fills the
+// cycles alternately from first and from second, so every city keeps the
+// position it has in one of the parents.
+template <typename Idx>
+static void cycle_crossover(const Idx *first, const Idx *second, Idx *child, int n)
+{
+    CrossoverScratch &scratch = thread_scratch();
+    scratch.reserve(n);
+    for (int k = 0; k < n; k++)
+        scratch.position[first[k]] = k;
+    bool from_first = true;
+    for (int start = 0; start < n; start++)
+    {
+        if (scratch.held.marked(first[start]))
+            continue;
+        int k = start;
+        do
+        {
+            child[k] = from_first ? first[k] : second[k];
+            scratch.held.mark(first[k]);
+            k = scratch.position[second[k]];
+        } while (k != start);
+        from_first = !from_first;
+    }
+}
+
+// ERX: builds the union of the parents' edges, at most four per city, and
+// walks it from first[0], always moving to the neighbour with the fewest
+// edges left; a city with none left jumps to a random unvisited one.
+template <typename Idx>
+static void edge_recombination(const Idx *first, const Idx *second, Idx *child, int n)
+{
+    CrossoverScratch &scratch = thread_scratch();
+    scratch.reserve(n);
+    int32_t *adjacency = scratch.adjacency.data();
+    uint8_t *degree = scratch.degree.data();
+    for (int c = 1; c <= n; c++)
+    {
+        degree[c] = 0;
+        scratch.left[c - 1] = c;
+        scratch.where[c] = c - 1;
+    }
+    for (const Idx *parent : {first, second})
+    {
+        for (int k = 0; k < n; k++)
+        {
+            int c = parent[k];
+            for (int m : {(int)parent[k == 0 ? n - 1 : k - 1], (int)parent[k == n - 1 ? 0 : k + 1]})
+            {
+                int32_t *edges = &adjacency[(size_t)c * 4];
+                if (std::find(edges, edges + degree[c], m) == edges + degree[c])
+                    edges[degree[c]++] = m;
+            }
+        }
+    }
+    int left = n;
+    int current = first[0];
+    for (int k = 0; k < n; k++)
+    {
+        child[k] = current;
+        int w = scratch.where[current];
+        scratch.left[w] = scratch.left[--left];
+        scratch.where[scratch.left[w]] = w;
+        const int32_t *edges = &adjacency[(size_t)current * 4];
+        int next = -1;
+        for (int e = 0; e < degree[current]; e++)
+        {
+            int m = edges[e];
+            int32_t *back = &adjacency[(size_t)m * 4];
+            int32_t *at = std::find(back, back + degree[m], current);
+            *at = back[--degree[m]];
+            if (next < 0 || degree[m] < degree[next])
+                next = m;
+        }
+        if (next < 0 && left > 0)
+            next = scratch.left[random_below(left)];
+        current = next;
+    }
+}
+
+// OX2 (Syswerda's order-based crossover): about half the positions of second
+// are chosen, and the child is first with the chosen cities put back in the
+// order second has them.
+template <typename Idx>
+static void order_based_crossover(const Idx *first, const Idx *second, Idx *child, int n)
+{
+    CrossoverScratch &scratch = thread_scratch();
+    scratch.reserve(n);
+    // One draw gives the coin flips of 32 positions.
+    uint32_t draw = 0;
+    for (int k = 0; k < n; k++)
+    {
+        if (k % 32 == 0)
+            draw = breeding_rng()();
+        if (draw >> (k % 32) & 1)
+            scratch.held.mark(second[k]);
+    }
+    int next = 0;
+    for (int k = 0; k < n; k++)
+    {
+        if (scratch.held.marked(first[k]))
+        {
+            while (!scratch.held.marked(second[next]))
+                next++;
+            child[k] = second[next++];
+        }
+        else
+        {
+            child[k] = first[k];
+        }
+    }
+}
+
+template <typename Idx>
+using CrossoverOperator = void (*)(const Idx *first, const Idx *second, Idx *child, int n);
+
+// Operator named by --crossover; eax needs the distances and lives in eax.hpp,
+// so it gets the order crossover here.
+template <typename Idx>
+static CrossoverOperator<Idx> crossover_operator(const char *name)
+{
+    if (strcmp(name, "pmx") == 0)
+        return pmx_crossover<Idx>;
+    if (strcmp(name, "cx") == 0)
+        return cycle_crossover<Idx>;
+    if (strcmp(name, "erx") == 0)
+        return edge_recombination<Idx>;
+    if (strcmp(name, "ox2") == 0)
+        return order_based_crossover<Idx>;
+    return ox_crossover<Idx>;
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef DIST_KERNELS_HPP
+#define DIST_KERNELS_HPP
+
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DIST_KERNELS_X86
+#endif
+
+// TSPLIB distance functions. Each metric maps file coordinates once through
+// coord() and then computes integer distances (stored as double) with the
+// rounding rule of its EDGE_WEIGHT_TYPE; vectorized metrics also provide an
+// AVX version that processes four pairs at a time. The AVX code is compiled
+// for its own target and only runs when CPUID reports AVX, as in
+// tour_kernels.hpp, so the binary does not need -mavx.
+
+struct Euc2D
+{
+    static const bool vectorized = true;
+
+    static inline double coord(double v)
+    {
+        return v;
+    }
+
+    static inline double distance(double xi, double yi, double xj, double yj)
+    {
+        double dx = xi - xj;
+        double dy = yi - yj;
+        return floor(sqrt(dx * dx + dy * dy) + 0.5);
+    }
+
+#ifdef DIST_KERNELS_X86
+    __attribute__((target("avx"))) static inline __m256d distance(__m256d xi, __m256d yi, __m256d xj, __m256d yj)
+    {
+        __m256d dx = _mm256_sub_pd(xi, xj);
+        __m256d dy = _mm256_sub_pd(yi, yj);
+        __m256d d = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+        return _mm256_floor_pd(_mm256_add_pd(d, _mm256_set1_pd(0.5)));
+    }
+#endif
+};
+
+struct Ceil2D
+{
+    static const bool vectorized = true;
+
+    static inline double coord(double v)
+    {
+        return v;
+    }
+
+    static inline double distance(double xi, double yi, double xj, double yj)
+    {
+        double dx = xi - xj;
+        double dy = yi - yj;
+        return ceil(sqrt(dx * dx + dy * dy));
+    }
+
+#ifdef DIST_KERNELS_X86
+    __attribute__((target("avx"))) static inline __m256d distance(__m256d xi, __m256d yi, __m256d xj, __m256d yj)
+    {
+        __m256d dx = _mm256_sub_pd(xi, xj);
+        __m256d dy = _mm256_sub_pd(yi, yj);
+        return _mm256_ceil_pd(_mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+    }
+#endif
+};
+
+// Pseudo-Euclidean distance of the att48/att532 instances.
+struct Att
+{
+    static const bool vectorized = true;
+
+    static inline double coord(double v)
+    {
+        return v;
+    }
+
+    static inline double distance(double xi, double yi, double xj, double yj)
+    {
+        double dx = xi - xj;
+        double dy = yi - yj;
+        double r = sqrt((dx * dx + dy * dy) / 10.0);
+        double t = floor(r + 0.5);
+        return t < r ? t + 1 : t;
+    }
+
+#ifdef DIST_KERNELS_X86
+    __attribute__((target("avx"))) static inline __m256d distance(__m256d xi, __m256d yi, __m256d xj, __m256d yj)
+    {
+        __m256d dx = _mm256_sub_pd(xi, xj);
+        __m256d dy = _mm256_sub_pd(yi, yj);
+        __m256d r = _mm256_sqrt_pd(_mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_set1_pd(10.0)));
+        __m256d t = _mm256_floor_pd(_mm256_add_pd(r, _mm256_set1_pd(0.5)));
+        return _mm256_add_pd(t, _mm256_and_pd(_mm256_cmp_pd(t, r, _CMP_LT_OQ), _mm256_set1_pd(1.0)));
+    }
+#endif
+};
+
+// Great-circle distance; coordinates are DDD.MM degrees, converted to radians once.
+struct Geo
+{
+    static const bool vectorized = false;
+
+    static inline double coord(double v)
+    {
+        const double pi = 3.141592;
+        double deg = trunc(v);
+        return pi * (deg + 5.0 * (v - deg) / 3.0) / 180.0;
+    }
+
+    static inline double distance(double xi, double yi, double xj, double yj)
+    {
+        const double rrr = 6378.388;
+        double q1 = cos(yi - yj);
+        double q2 = cos(xi - xj);
+        double q3 = cos(xi + xj);
+        return trunc(rrr * acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+    }
+};
+
+struct Man2D
+{
+    static const bool vectorized = true;
+
+    static inline double coord(double v)
+    {
+        return v;
+    }
+
+    static inline double distance(double xi, double yi, double xj, double yj)
+    {
+        return floor(fabs(xi - xj) + fabs(yi - yj) + 0.5);
+    }
+
+#ifdef DIST_KERNELS_X86
+    __attribute__((target("avx"))) static inline __m256d distance(__m256d xi, __m256d yi, __m256d xj, __m256d yj)
+    {
+        __m256d sign = _mm256_set1_pd(-0.0);
+        __m256d dx = _mm256_andnot_pd(sign, _mm256_sub_pd(xi, xj));
+        __m256d dy = _mm256_andnot_pd(sign, _mm256_sub_pd(yi, yj));
+        return _mm256_floor_pd(_mm256_add_pd(_mm256_add_pd(dx, dy), _mm256_set1_pd(0.5)));
+    }
+#endif
+};
+
+#ifdef DIST_KERNELS_X86
+// distance_row over the first count / 4 * 4 points; returns how many it did.
+template <typename Metric, typename T>
+__attribute__((target("avx"))) static int distance_row_avx(const double *x, const double *y, double xi, double yi,
+                                                           T *out, int count)
+{
+    __m256d vxi = _mm256_set1_pd(xi);
+    __m256d vyi = _mm256_set1_pd(yi);
+    alignas(32) double d[4];
+    int k = 0;
+    for (; k + 4 <= count; k += 4)
+    {
+        _mm256_store_pd(d, Metric::distance(vxi, vyi, _mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k)));
+        out[k] = d[0];
+        out[k + 1] = d[1];
+        out[k + 2] = d[2];
+        out[k + 3] = d[3];
+    }
+    return k;
+}
+
+// Sum of the first m / 4 * 4 edges of edge_sum.
+template <typename Metric>
+__attribute__((target("avx"))) static double edge_sum_avx(const double *bx, const double *by, int m)
+{
+    __m256d acc = _mm256_setzero_pd();
+    for (int k = 0; k + 4 <= m; k += 4)
+        acc = _mm256_add_pd(acc, Metric::distance(_mm256_loadu_pd(bx + k), _mm256_loadu_pd(by + k),
+                                                  _mm256_loadu_pd(bx + k + 1), _mm256_loadu_pd(by + k + 1)));
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+// Whether the AVX kernels can run here, from CPUID on the first call.
+static inline bool dist_kernels_avx()
+{
+#ifdef DIST_KERNELS_X86
+    static const bool avx = (__builtin_cpu_init(), __builtin_cpu_supports("avx"));
+    return avx;
+#else
+    return false;
+#endif
+}
+
+// out[k] = d((xi, yi), (x[k], y[k])) for k in [0, count).
+template <typename Metric, typename T>
+static inline void distance_row(const double *x, const double *y, double xi, double yi, T *out, int count)
+{
+    int k = 0;
+#ifdef DIST_KERNELS_X86
+    if constexpr (Metric::vectorized)
+    {
+        if (dist_kernels_avx())
+            k = distance_row_avx<Metric>(x, y, xi, yi, out, count);
+    }
+#endif
+    for (; k < count; k++)
+        out[k] = Metric::distance(xi, yi, x[k], y[k]);
+}
+
+// Sum of the m edge lengths between consecutive points of bx/by (m + 1 points).
+template <typename Metric>
+static inline double edge_sum(const double *bx, const double *by, int m)
+{
+    int k = 0;
+    double sum = 0;
+#ifdef DIST_KERNELS_X86
+    if constexpr (Metric::vectorized)
+    {
+        if (dist_kernels_avx())
+        {
+            sum = edge_sum_avx<Metric>(bx, by, m);
+            k = m / 4 * 4;
+        }
+    }
+#endif
+    for (; k < m; k++)
+        sum += Metric::distance(bx[k], by[k], bx[k + 1], by[k + 1]);
+    return sum;
+}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef DIST_MATRIX_HPP
+#define DIST_MATRIX_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <utility>
+#include "tsp_loader.hpp"
+
+// Exact tour length; every TSPLIB distance is an integer.
+typedef long long length_t;
+
+enum class MatrixLayout
+{
+    Full,
+    Upper
+};
+
+static const size_t cache_line_bytes = 64;
+static const int upper_layout_min_cities = 1000;
+static const int matrix_tile = 64;
+static const size_t huge_page_bytes = 2 * 1024 * 1024;
+
+// One zeroed block, cache-line aligned; blocks of at least one huge page are
+// huge-page aligned and advised for transparent huge pages.
+static void *aligned_block(size_t bytes)
+{
+    size_t alignment = bytes >= huge_page_bytes ? huge_page_bytes : cache_line_bytes;
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+    void *p = NULL;
+    if (posix_memalign(&p, alignment, bytes) != 0)
+    {
+        fprintf(stderr, "cannot allocate %zu bytes\n", bytes);
+        exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (alignment == huge_page_bytes)
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    memset(p, 0, bytes);
+    return p;
+}
+
+// Symmetric distance table in a single allocation. Full keeps every row padded
+// to a whole number of cache lines; Upper packs rows i..n-1 of each row i
+// (diagonal included), so it needs about half the memory. T is int32_t, or
+// uint16_t when every edge fits, which halves the table again.
+template <typename T, MatrixLayout L>
+class DistanceMatrix
+{
+public:
+    typedef T value_type;
+    static const MatrixLayout layout = L;
+
+    DistanceMatrix(int n) : n(n)
+    {
+        size_t per_line = cache_line_bytes / sizeof(T);
+        stride = (n + per_line - 1) / per_line * per_line;
+        count = L == MatrixLayout::Full ? stride * n : (size_t)n * (n + 1) / 2;
+        data = (T *)aligned_block(count * sizeof(T));
+    }
+
+    // Read-only view of a table written by a DistanceMatrix of the same n, e.g. a mapped cache.
+    DistanceMatrix(int n, const T *table) : n(n), owned(false)
+    {
+        size_t per_line = cache_line_bytes / sizeof(T);
+        stride = (n + per_line - 1) / per_line * per_line;
+        count = L == MatrixLayout::Full ? stride * n : (size_t)n * (n + 1) / 2;
+        data = (T *)table;
+    }
+
+    DistanceMatrix(DistanceMatrix &&other)
+        : n(other.n), stride(other.stride), count(other.count), data(other.data), owned(other.owned)
+    {
+        other.data = NULL;
+    }
+
+    DistanceMatrix(const DistanceMatrix &) = delete;
+    DistanceMatrix &operator=(const DistanceMatrix &) = delete;
+
+    ~DistanceMatrix()
+    {
+        if (owned)
+            free(data);
+    }
+
+    inline size_t index(int i, int j) const
+    {
+        if (L == MatrixLayout::Full)
+            return (size_t)i * stride + j;
+        size_t a = i < j ? i : j;
+        size_t b = i < j ? j : i;
+        return a * n - a * (a - 1) / 2 + (b - a);
+    }
+
+    inline T operator()(int i, int j) const
+    {
+        return data[index(i, j)];
+    }
+
+    // row(i)[j] is d(i, j) for every j (Full) or for j >= i (Upper).
+    inline T *row(int i)
+    {
+        return data + index(i, i) - i;
+    }
+
+    // Stores d(i, j); Full also mirrors it into d(j, i).
+    inline void set(int i, int j, T d)
+    {
+        data[index(i, j)] = d;
+        if (L == MatrixLayout::Full)
+            data[index(j, i)] = d;
+    }
+
+    inline void prefetch(int i, int j) const
+    {
+        __builtin_prefetch(&data[index(i, j)]);
+    }
+
+    int size() const
+    {
+        return n;
+    }
+
+    size_t bytes() const
+    {
+        return count * sizeof(T);
+    }
+
+    const T *table() const
+    {
+        return data;
+    }
+
+    // Entries between the starts of consecutive Full rows.
+    size_t row_stride() const
+    {
+        return stride;
+    }
+
+private:
+    int n;
+    size_t stride;
+    size_t count;
+    T *data;
+    bool owned = true;
+};
+
+// EDGE_WEIGHT_SECTION of an EXPLICIT instance, indexed as its EDGE_WEIGHT_FORMAT.
+class ExplicitWeights
+{
+public:
+    ExplicitWeights(const TspInstance &instance)
+        : n(instance.dimension), format(instance.weight_format), w(instance.weights.data()), count(instance.weights.size())
+    {
+    }
+
+    typedef int32_t value_type;
+
+    inline int32_t operator()(int i, int j) const
+    {
+        size_t a = i < j ? i : j;
+        size_t b = i < j ? j : i;
+        switch (format)
+        {
+        case WeightFormat::FullMatrix:
+            return w[(size_t)i * n + j];
+        case WeightFormat::UpperRow:
+            return a == b ? 0 : w[a * n - a * (a + 1) / 2 + (b - a - 1)];
+        case WeightFormat::LowerRow:
+            return a == b ? 0 : w[b * (b - 1) / 2 + a];
+        case WeightFormat::UpperDiagRow:
+            return w[a * n - a * (a - 1) / 2 + (b - a)];
+        case WeightFormat::LowerDiagRow:
+            return w[b * (b + 1) / 2 + a];
+        default:
+            return 0;
+        }
+    }
+
+    template <typename T>
+    inline void distances(int i, int j_begin, int j_end, T *out) const
+    {
+        for (int j = j_begin; j < j_end; j++)
+            out[j - j_begin] = (*this)(i, j);
+    }
+
+    double max_edge() const
+    {
+        double m = 0;
+        for (size_t k = 0; k < count; k++)
+            m = w[k] > m ? w[k] : m;
+        return m;
+    }
+
+private:
+    int n;
+    WeightFormat format;
+    const double *w;
+    size_t count;
+};
+
+// Number of matrix_tile x matrix_tile tiles covering the upper triangle.
+static inline long matrix_tiles(int n)
+{
+    long side = (n + matrix_tile - 1) / matrix_tile;
+    return side * (side + 1) / 2;
+}
+
+// Computes one tile of the upper triangle (tiles numbered row by row) one row
+// segment at a time from source, a CoordDistance or ExplicitWeights; Full also
+// mirrors the tile into the lower triangle while both halves are in cache.
+template <typename T, MatrixLayout L, typename Source>
+void fill_tile(DistanceMatrix<T, L> &m, const Source &source, long tile)
+{
+    int n = m.size();
+    int side = (n + matrix_tile - 1) / matrix_tile;
+    int ti = 0;
+    while (tile >= side - ti)
+    {
+        tile -= side - ti;
+        ti++;
+    }
+    int tj = ti + tile;
+    int i_end = (ti + 1) * matrix_tile < n ? (ti + 1) * matrix_tile : n;
+    int j_end = (tj + 1) * matrix_tile < n ? (tj + 1) * matrix_tile : n;
+    for (int i = ti * matrix_tile; i < i_end; i++)
+    {
+        int j_begin = ti == tj ? i + 1 : tj * matrix_tile;
+        if (j_begin >= j_end)
+            continue;
+        T *row = m.row(i);
+        source.distances(i, j_begin, j_end, row + j_begin);
+        if (L == MatrixLayout::Full)
+        {
+            for (int j = j_begin; j < j_end; j++)
+                m.row(j)[i] = row[j];
+        }
+    }
+}
+
+// Length of the closed tour over path[0..n), which holds 1-based city ids
+// of any integer width.
+template <typename Dist, typename Idx>
+static inline length_t tour_length(const Dist &dist, const Idx *path, int n)
+{
+    length_t distance = 0;
+    for (int i = 0; i < n - 1; i++)
+    {
+        if (i + 8 < n - 1)
+            dist.prefetch(path[i + 8] - 1, path[i + 9] - 1);
+        distance += dist(path[i] - 1, path[i + 1] - 1);
+    }
+    distance += dist(path[n - 1] - 1, path[0] - 1);
+    return distance;
+}
+
+// "auto" switches to the packed layout once the full table stops fitting in cache.
+static inline bool upper_layout(const char *layout, int n)
+{
+    if (strcmp(layout, "auto") == 0)
+        return n >= upper_layout_min_cities;
+    return strcmp(layout, "upper") == 0;
+}
+
+#endif
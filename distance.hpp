@@ -0,0 +1,109 @@
+#ifndef DISTANCE_HPP
+#define DISTANCE_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tsp_loader.hpp"
+#include "dist_kernels.hpp"
+#include "dist_matrix.hpp"
+#include "tour_kernels.hpp"
+#include "coord_distance.hpp"
+#include "ga_options.hpp"
+#include "tsp_cache.hpp"
+
+// Picks the distance backend once, from the instance EDGE_WEIGHT_TYPE and the
+// options, and calls run(dist) with it, so every hot loop of the GA is
+// instantiated for one concrete metric, layout and entry type. Tables come
+// from the mapped cache when it holds a matching one; otherwise they are
+// filled by build(matrix, source), where source is the CoordDistance or
+// ExplicitWeights the table is computed from, and written back to the cache.
+template <typename T, MatrixLayout L, typename Source, typename Build, typename Run>
+static void with_table(const TspInstance &instance, const Source &source, TspCache &cache, Build &build, Run &run)
+{
+    const T *cached = cache.matrix<T, L>();
+    if (cached != NULL)
+    {
+        DistanceMatrix<T, L> dist(instance.dimension, cached);
+        run(dist);
+        return;
+    }
+    DistanceMatrix<T, L> dist(instance.dimension);
+    build(dist, source);
+    cache.store(instance, dist.table(), dist.bytes(), (int)L, sizeof(T));
+    run(dist);
+}
+
+template <typename T, typename Source, typename Build, typename Run>
+static void with_layout(const TspInstance &instance, const Source &source, const GaOptions &options, TspCache &cache,
+                        Build &build, Run &run)
+{
+    if (upper_layout(options.layout, instance.dimension))
+        with_table<T, MatrixLayout::Upper>(instance, source, cache, build, run);
+    else
+        with_table<T, MatrixLayout::Full>(instance, source, cache, build, run);
+}
+
+template <typename Source, typename Build, typename Run>
+static void with_matrix(const TspInstance &instance, const Source &source, const GaOptions &options, TspCache &cache,
+                        Build &build, Run &run)
+{
+    bool fits = source.max_edge() <= UINT16_MAX;
+    if (strcmp(options.weights, "uint16") == 0 && !fits)
+    {
+        fprintf(stderr, "edges longer than %d do not fit --weights=uint16\n", UINT16_MAX);
+        exit(1);
+    }
+    if (strcmp(options.weights, "int32") != 0 && fits)
+        with_layout<uint16_t>(instance, source, options, cache, build, run);
+    else
+        with_layout<int32_t>(instance, source, options, cache, build, run);
+}
+
+template <typename Metric, typename Build, typename Run>
+static void with_metric(const TspInstance &instance, const GaOptions &options, TspCache &cache, Build &build, Run &run)
+{
+    CoordDistance<Metric> coords(instance);
+    if (matrix_free(options.backend, instance.dimension))
+    {
+        if (!cache.mapped())
+            cache.store(instance, NULL, 0, 0, 0);
+        run(coords);
+    }
+    else
+    {
+        with_matrix(instance, coords, options, cache, build, run);
+    }
+}
+
+template <typename Build, typename Run>
+static void with_distance(const TspInstance &instance, const GaOptions &options, TspCache &cache, Build build, Run run)
+{
+    switch (instance.weight_type)
+    {
+    case EdgeWeight::Euc2D:
+        with_metric<Euc2D>(instance, options, cache, build, run);
+        break;
+    case EdgeWeight::Ceil2D:
+        with_metric<Ceil2D>(instance, options, cache, build, run);
+        break;
+    case EdgeWeight::Att:
+        with_metric<Att>(instance, options, cache, build, run);
+        break;
+    case EdgeWeight::Geo:
+        with_metric<Geo>(instance, options, cache, build, run);
+        break;
+    case EdgeWeight::Man2D:
+        with_metric<Man2D>(instance, options, cache, build, run);
+        break;
+    case EdgeWeight::Explicit:
+        if (strcmp(options.backend, "coords") == 0)
+        {
+            fprintf(stderr, "EXPLICIT instances have no coordinates, use --backend=matrix\n");
+            exit(1);
+        }
+        with_matrix(instance, ExplicitWeights(instance), options, cache, build, run);
+        break;
+    }
+}
+
+#endif
@@ -0,0 +1,357 @@
+#ifndef EAX_HPP
+#define EAX_HPP
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include "dist_matrix.hpp"
+#include "candidates.hpp"
+#include "breeding_rng.hpp"
+
+// Edge assembly crossover (Nagata), single AB-cycle strategy (EAX-1AB):
+//  1. the edges of the parents A and B, minus the ones they share, split into
+//     AB-cycles, closed walks whose edges alternate between A and B;
+//  2. one AB-cycle is the E-set: the child starts as A with the A-edges of
+//     the E-set swapped for its B-edges, which leaves a set of subtours;
+//  3. the subtours are merged, smallest first, by the cheapest 2-exchange
+//     that joins one of its edges with an edge of another subtour, looking
+//     only at the candidate lists of its cities.
+// Cities are 1..n as in the tours; dist and the candidate lists are 0-based.
+// Everything is O(n) per child apart from the merges, which cost the size of
+// the subtour times the candidates per city.
+
+// Per-thread workspace, grown on demand.
+struct EaxWorkspace
+{
+    // Remaining A- and B-edges per city during the decomposition.
+    std::vector<int32_t> a_edge, b_edge;
+    std::vector<uint8_t> a_count, b_count;
+    // The walk, and where each city sits on it at even and odd positions.
+    std::vector<int32_t> walk;
+    std::vector<int32_t> at;
+    // AB-cycles, flattened: cycle c is cycle[offset[c]..offset[c + 1]) and
+    // its first edge is an A-edge when starts_a[c].
+    std::vector<int32_t> cycle, offset;
+    std::vector<uint8_t> starts_a;
+    // First as two neighbours per city, and the child being built from it.
+    std::vector<int32_t> base, link;
+    // Subtours: id per city, and their cities as linked lists.
+    std::vector<int32_t> tour, next_member, head, tail, size;
+    // Min-heap of (size, subtour); entries whose size is out of date are
+    // skipped when they reach the top.
+    std::vector<std::pair<int32_t, int32_t>> by_size;
+
+    void reserve(int n)
+    {
+        if ((int)at.size() < 2 * (n + 1))
+        {
+            a_edge.resize(2 * (n + 1));
+            b_edge.resize(2 * (n + 1));
+            a_count.resize(n + 1);
+            b_count.resize(n + 1);
+            at.resize(2 * (n + 1));
+            base.resize(2 * (n + 1));
+            link.resize(2 * (n + 1));
+            tour.resize(n + 1);
+            next_member.resize(n + 1);
+            head.resize(n + 1);
+            tail.resize(n + 1);
+            size.resize(n + 1);
+        }
+        walk.clear();
+        cycle.clear();
+        offset.assign(1, 0);
+        starts_a.clear();
+    }
+};
+
+static inline EaxWorkspace &eax_workspace()
+{
+    static thread_local EaxWorkspace workspace;
+    return workspace;
+}
+
+static inline void drop_edge(int32_t *edges, uint8_t &count, int city)
+{
+    int32_t *at = std::find(edges, edges + count, city);
+    *at = edges[--count];
+}
+
+// Splits A xor B into AB-cycles with random alternating walks. A city is
+// entered at even positions by B-edges (or is the start) and at odd ones by
+// A-edges; reaching a city again at the parity it already holds on the walk
+// closes an alternating cycle, which is cut off the walk. Returns false if
+// the walk gets stuck, which a consistent pair of tours never does.
+template <typename Idx>
+static bool ab_cycles(EaxWorkspace &w, const Idx *first, const Idx *second, int n)
+{
+    for (int c = 1; c <= n; c++)
+        w.a_count[c] = w.b_count[c] = 0;
+    for (int k = 0; k < n; k++)
+    {
+        int a = first[k], a2 = first[k == n - 1 ? 0 : k + 1];
+        w.a_edge[2 * a + w.a_count[a]++] = a2;
+        w.a_edge[2 * a2 + w.a_count[a2]++] = a;
+        int b = second[k], b2 = second[k == n - 1 ? 0 : k + 1];
+        w.b_edge[2 * b + w.b_count[b]++] = b2;
+        w.b_edge[2 * b2 + w.b_count[b2]++] = b;
+    }
+    for (int c = 1; c <= n; c++)
+    {
+        w.at[2 * c] = w.at[2 * c + 1] = -1;
+        for (int e = 0; e < w.a_count[c]; e++)
+        {
+            int d = w.a_edge[2 * c + e];
+            if (std::find(&w.b_edge[2 * c], &w.b_edge[2 * c] + w.b_count[c], d) != &w.b_edge[2 * c] + w.b_count[c])
+            {
+                drop_edge(&w.a_edge[2 * c], w.a_count[c], d);
+                drop_edge(&w.b_edge[2 * c], w.b_count[c], d);
+                e--;
+            }
+        }
+    }
+    for (int start = 1; start <= n; start++)
+    {
+        while (w.a_count[start] > 0)
+        {
+            w.walk.assign(1, start);
+            w.at[2 * start] = 0;
+            while (!w.walk.empty())
+            {
+                int q = w.walk.size() - 1;
+                int c = w.walk[q];
+                bool use_a = q % 2 == 0;
+                int32_t *edges = use_a ? &w.a_edge[2 * c] : &w.b_edge[2 * c];
+                uint8_t &count = use_a ? w.a_count[c] : w.b_count[c];
+                if (count == 0)
+                {
+                    if (q == 0)
+                        break;
+                    return false;
+                }
+                int d = edges[count == 1 ? 0 : random_below(count)];
+                drop_edge(edges, count, d);
+                drop_edge(use_a ? &w.a_edge[2 * d] : &w.b_edge[2 * d], use_a ? w.a_count[d] : w.b_count[d], c);
+                int parity = (q + 1) % 2;
+                int p = w.at[2 * d + parity];
+                if (p < 0)
+                {
+                    w.at[2 * d + parity] = q + 1;
+                    w.walk.push_back(d);
+                    continue;
+                }
+                // The cycle is walk[p..q] closed by the edge (c, d).
+                w.starts_a.push_back(p % 2 == 0);
+                for (int i = p; i <= q; i++)
+                {
+                    w.cycle.push_back(w.walk[i]);
+                    if (i > p)
+                        w.at[2 * w.walk[i] + i % 2] = -1;
+                }
+                w.offset.push_back(w.cycle.size());
+                w.walk.resize(p + 1);
+                if (p == 0 && w.a_count[d] == 0)
+                {
+                    w.at[2 * d] = -1;
+                    w.walk.clear();
+                }
+            }
+            w.at[2 * start] = -1;
+        }
+    }
+    return true;
+}
+
+static inline void replace_link(int32_t *link, int c, int from, int to)
+{
+    link[2 * c + (link[2 * c] == from ? 0 : 1)] = to;
+}
+
+// Merges the subtours of w.link into one tour, smallest subtour first, and
+// returns how much the merges added to its length.
+template <typename Dist>
+static length_t merge_subtours(EaxWorkspace &w, const Dist &dist, const CandidateLists &candidates, int n)
+{
+    int32_t *link = w.link.data();
+    int tours = 0;
+    for (int c = 1; c <= n; c++)
+        w.tour[c] = -1;
+    for (int c = 1; c <= n; c++)
+    {
+        if (w.tour[c] >= 0)
+            continue;
+        w.head[tours] = w.tail[tours] = c;
+        w.size[tours] = 0;
+        int prev = link[2 * c + 1], at = c;
+        do
+        {
+            w.tour[at] = tours;
+            w.next_member[at] = -1;
+            if (at != c)
+            {
+                w.next_member[w.tail[tours]] = at;
+                w.tail[tours] = at;
+            }
+            w.size[tours]++;
+            int next = link[2 * at] == prev ? link[2 * at + 1] : link[2 * at];
+            prev = at;
+            at = next;
+        } while (at != c);
+        tours++;
+    }
+    auto smaller = std::greater<std::pair<int32_t, int32_t>>();
+    w.by_size.clear();
+    for (int t = 0; t < tours; t++)
+        w.by_size.emplace_back(w.size[t], t);
+    std::make_heap(w.by_size.begin(), w.by_size.end(), smaller);
+    auto d = [&](int a, int b)
+    { return (length_t)dist(a - 1, b - 1); };
+    length_t added = 0;
+    for (int left = tours; left > 1; left--)
+    {
+        int small = -1;
+        while (small < 0)
+        {
+            std::pop_heap(w.by_size.begin(), w.by_size.end(), smaller);
+            std::pair<int32_t, int32_t> top = w.by_size.back();
+            w.by_size.pop_back();
+            if (w.size[top.second] == top.first)
+                small = top.second;
+        }
+        length_t best = 0;
+        int bu = -1, bu2 = -1, bv = -1, bv2 = -1;
+        auto offer = [&](int u, int v)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                for (int j = 0; j < 2; j++)
+                {
+                    int u2 = link[2 * u + i], v2 = link[2 * v + j];
+                    length_t gain = d(u, v) + d(u2, v2) - d(u, u2) - d(v, v2);
+                    if (bu < 0 || gain < best)
+                    {
+                        best = gain;
+                        bu = u;
+                        bu2 = u2;
+                        bv = v;
+                        bv2 = v2;
+                    }
+                }
+            }
+        };
+        for (int u = w.head[small]; u >= 0; u = w.next_member[u])
+        {
+            if (candidates.size() == n)
+            {
+                for (const int32_t *v = candidates.begin(u - 1); v != candidates.end(u - 1); v++)
+                {
+                    if (w.tour[*v + 1] != small)
+                        offer(u, *v + 1);
+                }
+            }
+        }
+        // No candidate leaves the subtour: join it to the nearest outside city.
+        if (bu < 0)
+        {
+            int u = w.head[small];
+            int nearest = -1;
+            for (int v = 1; v <= n; v++)
+            {
+                if (w.tour[v] != small && (nearest < 0 || d(u, v) < d(u, nearest)))
+                    nearest = v;
+            }
+            offer(u, nearest);
+        }
+        replace_link(link, bu, bu2, bv);
+        replace_link(link, bu2, bu, bv2);
+        replace_link(link, bv, bv2, bu);
+        replace_link(link, bv2, bv, bu2);
+        int big = w.tour[bv];
+        int from = small, into = big;
+        if (w.size[from] > w.size[into])
+            std::swap(from, into);
+        for (int c = w.head[from]; c >= 0; c = w.next_member[c])
+            w.tour[c] = into;
+        w.next_member[w.tail[into]] = w.head[from];
+        w.tail[into] = w.tail[from];
+        w.size[into] += w.size[from];
+        w.size[from] = 0;
+        w.by_size.emplace_back(w.size[into], into);
+        std::push_heap(w.by_size.begin(), w.by_size.end(), smaller);
+        added += best;
+    }
+    return added;
+}
+
+// E-sets tried per child; the shortest result is kept.
+static const int eax_tries = 8;
+
+// One EAX-1AB child of first and second: up to eax_tries AB-cycles are each
+// tried as the E-set on a fresh copy of first, and the shortest child wins
+// even when it is longer than first.
+// Parents that differ in no edge, or a decomposition that fails, give a copy
+// of first.
+template <typename Dist, typename Idx>
+static void eax_crossover(const Dist &dist, const CandidateLists &candidates, const Idx *first, const Idx *second,
+                          Idx *child, int n)
+{
+    EaxWorkspace &w = eax_workspace();
+    w.reserve(n);
+    int cycles = ab_cycles(w, first, second, n) ? (int)w.offset.size() - 1 : 0;
+    std::copy(first, first + n, child);
+    if (cycles == 0)
+        return;
+    int32_t *base = w.base.data();
+    int32_t *link = w.link.data();
+    for (int k = 0; k < n; k++)
+    {
+        base[2 * first[k]] = first[k == 0 ? n - 1 : k - 1];
+        base[2 * first[k] + 1] = first[k == n - 1 ? 0 : k + 1];
+    }
+    auto d = [&](int a, int b)
+    { return (length_t)dist(a - 1, b - 1); };
+    length_t best = 0;
+    int c0 = random_below(cycles);
+    for (int t = 0; t < std::min(cycles, eax_tries); t++)
+    {
+        std::copy(base, base + 2 * (n + 1), link);
+        // The E-set: every A-edge of the cycle is replaced by the B-edges at
+        // its ends. Dropping first and adding after keeps two links per city.
+        int c = (c0 + t) % cycles;
+        const int32_t *e = &w.cycle[w.offset[c]];
+        int len = w.offset[c + 1] - w.offset[c];
+        int a_first = w.starts_a[c] ? 0 : 1;
+        length_t delta = 0;
+        for (int i = a_first; i < len; i += 2)
+        {
+            int u = e[i], v = e[(i + 1) % len];
+            replace_link(link, u, v, -1);
+            replace_link(link, v, u, -1);
+            delta -= d(u, v);
+        }
+        for (int i = 1 - a_first; i < len; i += 2)
+        {
+            int u = e[i], v = e[(i + 1) % len];
+            replace_link(link, u, -1, v);
+            replace_link(link, v, -1, u);
+            delta += d(u, v);
+        }
+        delta += merge_subtours(w, dist, candidates, n);
+        if (t > 0 && delta >= best)
+            continue;
+        best = delta;
+        int prev = link[2 * first[0]], at = first[0];
+        for (int k = 0; k < n; k++)
+        {
+            child[k] = at;
+            int next = link[2 * at] == prev ? link[2 * at + 1] : link[2 * at];
+            prev = at;
+            at = next;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef GA_OPTIONS_HPP
+#define GA_OPTIONS_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+struct GaOptions
+{
+    const char *layout = "auto";
+    const char *backend = "auto";
+    const char *weights = "auto";
+    bool cache = false;
+    const char *reorder = "none";
+    int neighbors = 8;
+    const char *wheel = "prefix";
+    const char *selection = "roulette";
+    int tournament = 3;
+    const char *crossover = "ox";
+    double swap_rate = 0.2;
+    double inversion_rate = 0.2;
+    double insertion_rate = 0.1;
+    double scramble_rate = 0.05;
+    const char *local_search = "none";
+    int search_moves = 1;
+    int lk_elites = 0;
+    int lk_ms = 10;
+};
+
+[[maybe_unused]] static const char *ga_options_usage = "[--layout=auto|full|upper] [--backend=auto|matrix|coords] [--weights=auto|int32|uint16] [--cache] [--reorder=none|hilbert|morton] [--neighbors=K] [--wheel=prefix|alias] [--selection=roulette|tournament|sus|rank] [--tournament=K] [--crossover=ox|pmx|cx|erx|ox2|eax] [--swap-rate=P] [--inversion-rate=P] [--insertion-rate=P] [--scramble-rate=P] [--local-search=none|2opt|oropt|2opt+oropt] [--search-moves=M] [--lk-elites=K] [--lk-ms=MS]";
+
+static const char *option_choice(const char *name, const char *value, const char *const *choices)
+{
+    for (int i = 0; choices[i] != NULL; i++)
+    {
+        if (strcmp(value, choices[i]) == 0)
+            return choices[i];
+    }
+    fprintf(stderr, "invalid value '%s' for --%s\n", value, name);
+    exit(1);
+}
+
+static int option_count(const char *name, const char *value, int min, int max)
+{
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || v < min || v > max)
+    {
+        fprintf(stderr, "invalid value '%s' for --%s\n", value, name);
+        exit(1);
+    }
+    return v;
+}
+
+static double option_rate(const char *name, const char *value)
+{
+    char *end;
+    double v = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || !(v >= 0 && v <= 1))
+    {
+        fprintf(stderr, "invalid value '%s' for --%s\n", value, name);
+        exit(1);
+    }
+    return v;
+}
+
+// Parses the --options and moves the positional arguments to argv[first..argc).
+static inline int parse_options(int argc, char **argv, GaOptions *opts)
+{
+    static const char *const layouts[] = {"auto", "full", "upper", NULL};
+    static const char *const backends[] = {"auto", "matrix", "coords", NULL};
+    static const char *const weights[] = {"auto", "int32", "uint16", NULL};
+    static const char *const curves[] = {"none", "hilbert", "morton", NULL};
+    static const char *const wheels[] = {"prefix", "alias", NULL};
+    static const char *const crossovers[] = {"ox", "pmx", "cx", "erx", "ox2", "eax", NULL};
+    static const char *const searches[] = {"none", "2opt", "oropt", "2opt+oropt", NULL};
+    static const char *const selections[] = {"roulette", "tournament", "sus", "rank", NULL};
+    static struct option long_options[] = {
+        {"layout", required_argument, NULL, 'l'},
+        {"backend", required_argument, NULL, 'b'},
+        {"weights", required_argument, NULL, 'w'},
+        {"cache", no_argument, NULL, 'c'},
+        {"reorder", required_argument, NULL, 'r'},
+        {"neighbors", required_argument, NULL, 'n'},
+        {"wheel", required_argument, NULL, 'W'},
+        {"selection", required_argument, NULL, 's'},
+        {"tournament", required_argument, NULL, 't'},
+        {"crossover", required_argument, NULL, 'x'},
+        {"swap-rate", required_argument, NULL, 'S'},
+        {"inversion-rate", required_argument, NULL, 'I'},
+        {"insertion-rate", required_argument, NULL, 'N'},
+        {"scramble-rate", required_argument, NULL, 'R'},
+        {"local-search", required_argument, NULL, 'L'},
+        {"search-moves", required_argument, NULL, 'm'},
+        {"lk-elites", required_argument, NULL, 'K'},
+        {"lk-ms", required_argument, NULL, 'M'},
+        {NULL, 0, NULL, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'l':
+            opts->layout = option_choice("layout", optarg, layouts);
+            break;
+        case 'b':
+            opts->backend = option_choice("backend", optarg, backends);
+            break;
+        case 'w':
+            opts->weights = option_choice("weights", optarg, weights);
+            break;
+        case 'c':
+            opts->cache = true;
+            break;
+        case 'r':
+            opts->reorder = option_choice("reorder", optarg, curves);
+            break;
+        case 'n':
+            opts->neighbors = option_count("neighbors", optarg, 0, 1000);
+            break;
+        case 'W':
+            opts->wheel = option_choice("wheel", optarg, wheels);
+            break;
+        case 's':
+            opts->selection = option_choice("selection", optarg, selections);
+            break;
+        case 't':
+            opts->tournament = option_count("tournament", optarg, 1, 64);
+            break;
+        case 'x':
+            opts->crossover = option_choice("crossover", optarg, crossovers);
+            break;
+        case 'S':
+            opts->swap_rate = option_rate("swap-rate", optarg);
+            break;
+        case 'I':
+            opts->inversion_rate = option_rate("inversion-rate", optarg);
+            break;
+        case 'N':
+            opts->insertion_rate = option_rate("insertion-rate", optarg);
+            break;
+        case 'R':
+            opts->scramble_rate = option_rate("scramble-rate", optarg);
+            break;
+        case 'L':
+            opts->local_search = option_choice("local-search", optarg, searches);
+            break;
+        case 'm':
+            opts->search_moves = option_count("search-moves", optarg, 1, 1000);
+            break;
+        case 'K':
+            opts->lk_elites = option_count("lk-elites", optarg, 0, 1 << 20);
+            break;
+        case 'M':
+            opts->lk_ms = option_count("lk-ms", optarg, 1, 60000);
+            break;
+        default:
+            exit(1);
+        }
+    }
+    return optind;
+}
+
+#endif
@@ -0,0 +1,824 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include "tsp_loader.hpp"
+#include "ga_options.hpp"
+#include "distance.hpp"
+#include "hilbert.hpp"
+#include "population.hpp"
+#include "selection.hpp"
+#include "crossover.hpp"
+#include "eax.hpp"
+#include "local_search.hpp"
+
+using namespace std;
+
+// Microbenchmarks for the building blocks of the GA drivers. Each mode loads
+// one instance and times a single kernel in isolation.
+
+// Hardware cache-miss counter for the calling thread; reads -1 when perf
+// events are not available (containers, perf_event_paranoid).
+class MissCounter
+{
+public:
+    MissCounter()
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~MissCounter()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    void start()
+    {
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop()
+    {
+        long long count = -1;
+        if (fd < 0)
+            return count;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            count = -1;
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+// Nearest-neighbour tour from city 1, in file ids.
+static vector<int> nearest_neighbor_tour(const TspInstance &instance)
+{
+    int n = instance.dimension;
+    vector<int> tour(n);
+    vector<bool> visited(n, false);
+    int c = 0;
+    visited[0] = true;
+    tour[0] = 1;
+    for (int k = 1; k < n; k++)
+    {
+        int best = -1;
+        double best_d = 0;
+        for (int j = 0; j < n; j++)
+        {
+            if (visited[j])
+                continue;
+            double dx = instance.x[c] - instance.x[j];
+            double dy = instance.y[c] - instance.y[j];
+            double d = dx * dx + dy * dy;
+            if (best < 0 || d < best_d)
+            {
+                best = j;
+                best_d = d;
+            }
+        }
+        visited[best] = true;
+        tour[k] = best + 1;
+        c = best;
+    }
+    return tour;
+}
+
+// Times tour_length over the given tours, relabelled to the numbering of dist.
+template <typename Dist>
+static void time_tours(const char *label, const Dist &dist, const vector<vector<int>> &tours,
+                       const vector<int> &label_of, int rounds)
+{
+    int n = dist.size();
+    vector<vector<int>> paths(tours.size(), vector<int>(n));
+    for (size_t t = 0; t < tours.size(); t++)
+        for (int k = 0; k < n; k++)
+            paths[t][k] = label_of[tours[t][k]];
+    MissCounter misses;
+    length_t total = 0;
+    misses.start();
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t t = 0; t < paths.size(); t++)
+            total += tour_length(dist, &paths[t][0], n);
+    double usec = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    long long count = misses.stop();
+    long long evals = (long long)rounds * paths.size();
+    printf("  %-8s %10.2f usec/tour", label, usec / evals);
+    if (count >= 0)
+        printf("  %10.1f misses/tour", (double)count / evals);
+    printf("  (sum %lld)\n", total / rounds);
+}
+
+// reorder: evaluates the same nearest-neighbour and random tours on a table
+// built in file order and on tables renumbered along each curve.
+static int bench_reorder(int argc, char **argv)
+{
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    if (argc - first < 1)
+    {
+        printf("Usage: ga_tsp_bench reorder %s <tsp_file_path> [tours]\n", ga_options_usage);
+        return 0;
+    }
+    int count = argc - first > 1 ? stoi(argv[first + 1]) : 64;
+    TspInstance original = load_tsp(argv[first], 1);
+    int n = original.dimension;
+    if (original.x.empty())
+    {
+        fprintf(stderr, "%s: reorder needs coordinates\n", argv[first]);
+        return 1;
+    }
+
+    vector<vector<int>> good(1, nearest_neighbor_tour(original));
+    vector<vector<int>> random(count, vector<int>(n));
+    mt19937 rng(12345);
+    for (auto &tour : random)
+    {
+        iota(tour.begin(), tour.end(), 1);
+        shuffle(tour.begin(), tour.end(), rng);
+    }
+    int good_rounds = max(1, 20000000 / n);
+    int random_rounds = max(1, 20000000 / (n * count));
+
+    for (const char *curve : {"none", "hilbert", "morton"})
+    {
+        TspInstance instance = original;
+        curve_renumber(instance, curve);
+        vector<int> label_of(n + 1);
+        for (int k = 0; k < n; k++)
+            label_of[instance.ids.empty() ? k + 1 : instance.ids[k]] = k + 1;
+        TspCache cache;
+        printf("%s:\n", curve);
+        with_distance(
+            instance, options, cache, [](auto &dist, const auto &source)
+            {
+                for (long t = 0; t < matrix_tiles(dist.size()); t++)
+                    fill_tile(dist, source, t);
+            },
+            [&](const auto &dist)
+            {
+                time_tours("nn", dist, good, label_of, good_rounds);
+                time_tours("random", dist, random, label_of, random_rounds);
+            });
+    }
+    return 0;
+}
+
+// Tours per second of one tour kernel over the given random tours.
+template <typename T, MatrixLayout L, typename Idx>
+static void time_kernel(const char *label, TourKernel<T, Idx> kernel, const DistanceMatrix<T, L> &dist,
+                        const vector<vector<Idx>> &tours)
+{
+    int n = dist.size();
+    int rounds = max(1, 50000000 / (n * (int)tours.size()));
+    length_t total = 0;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (const auto &tour : tours)
+            total += kernel(dist.table(), dist.row_stride(), n, tour.data());
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("  %-8s %12.0f tours/s  (sum %lld)\n", label, rounds * tours.size() / sec, total / rounds);
+}
+
+template <typename T, MatrixLayout L, typename Idx>
+static void bench_kernels(const TspInstance &instance, const char *table)
+{
+    int n = instance.dimension;
+    CoordDistance<Euc2D> coords(instance);
+    DistanceMatrix<T, L> dist(n);
+    for (long t = 0; t < matrix_tiles(n); t++)
+        fill_tile(dist, coords, t);
+    vector<vector<Idx>> tours(16, vector<Idx>(n));
+    mt19937 rng(n);
+    for (auto &tour : tours)
+    {
+        iota(tour.begin(), tour.end(), 1);
+        shuffle(tour.begin(), tour.end(), rng);
+    }
+    printf("%d cities, %s, %zu bytes:\n", n, table, dist.bytes());
+    time_kernel<T, L, Idx>("scalar", tour_scalar<T, L, Idx>, dist, tours);
+#ifdef TOUR_KERNELS_X86
+    if (__builtin_cpu_supports("avx2"))
+        time_kernel<T, L, Idx>("avx2", tour_avx2<T, L, Idx>, dist, tours);
+    if (__builtin_cpu_supports("avx512f"))
+        time_kernel<T, L, Idx>("avx512", tour_avx512<T, L, Idx>, dist, tours);
+#endif
+}
+
+// tour: tours/s of every tour kernel the CPU supports, on random uniform
+// instances of the given sizes, for each table layout and entry type.
+static int bench_tour(int argc, char **argv)
+{
+    vector<int> sizes;
+    for (int a = 1; a < argc; a++)
+        sizes.push_back(stoi(argv[a]));
+    if (sizes.empty())
+        sizes = {100, 1000, 5000, 20000};
+    printf("dispatch: %s\n", tour_kernel_name());
+    for (int n : sizes)
+    {
+        TspInstance instance;
+        instance.dimension = n;
+        instance.x.resize(n);
+        instance.y.resize(n);
+        mt19937 rng(1);
+        uniform_real_distribution<double> pos(0, 40000);
+        for (int i = 0; i < n; i++)
+        {
+            instance.x[i] = floor(pos(rng));
+            instance.y[i] = floor(pos(rng));
+        }
+        with_index(n, [&](auto idx)
+                   {
+                       typedef decltype(idx) Idx;
+                       bench_kernels<int32_t, MatrixLayout::Full, Idx>(instance, "int32 full");
+                       bench_kernels<int32_t, MatrixLayout::Upper, Idx>(instance, "int32 upper");
+                       bench_kernels<uint16_t, MatrixLayout::Full, Idx>(instance, "uint16 full");
+                       bench_kernels<uint16_t, MatrixLayout::Upper, Idx>(instance, "uint16 upper");
+                   });
+    }
+    return 0;
+}
+
+// Time per generation of one way of drawing the population_size / 2 mates:
+// build once, then draw. Slow draws stop after a second and are extrapolated.
+template <typename Build, typename Draw>
+static void time_draws(const char *label, int size, Build build, Draw draw)
+{
+    mt19937 rng(size);
+    uniform_real_distribution<double> unit(0, 1);
+    auto start = chrono::steady_clock::now();
+    build();
+    double build_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    int draws = size / 2, done = 0;
+    long check = 0;
+    double draw_sec = 0;
+    start = chrono::steady_clock::now();
+    while (done < draws)
+    {
+        check += draw(unit(rng));
+        if (++done % 64 == 0)
+        {
+            draw_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (draw_sec > 1)
+                break;
+        }
+    }
+    draw_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double per_draw = draw_sec / done;
+    printf("  %-8s build %10.3f ms  draw %10.1f ns  generation %12.3f ms  (mean slot %ld)\n", label,
+           build_sec * 1e3, per_draw * 1e9, (build_sec + per_draw * draws) * 1e3, check / done);
+}
+
+// select: roulette draws per generation with the linear running-sum scan,
+// binary search on the cumulative weights and the alias table, for
+// populations of the given sizes.
+static int bench_select(int argc, char **argv)
+{
+    vector<int> sizes;
+    for (int a = 1; a < argc; a++)
+        sizes.push_back(stoi(argv[a]));
+    if (sizes.empty())
+        sizes = {10000, 100000, 1000000};
+    for (int size : sizes)
+    {
+        SelectionWeights selection;
+        selection.fitness.resize(size);
+        mt19937 rng(1);
+        uniform_int_distribution<int> length(10000, 100000);
+        float sum = 0;
+        for (int i = 0; i < size; i++)
+        {
+            selection.fitness[i] = 1.0f / length(rng);
+            sum += selection.fitness[i];
+        }
+        normalize_selection(selection, sum, 1, SerialBlocks());
+        printf("%d individuals:\n", size);
+        time_draws(
+            "scan", size, []() {},
+            [&](double r)
+            {
+                float running = 0;
+                for (int j = 0; j < size; j++)
+                {
+                    running += selection.probability[j];
+                    if (running > r)
+                        return j;
+                }
+                return size - 1;
+            });
+        time_draws(
+            "prefix", size, [&]()
+            { normalize_selection(selection, sum, 1, SerialBlocks()); },
+            [&](double r)
+            { return roulette_slot(selection.cumulative, r); });
+        AliasTable wheel;
+        time_draws(
+            "alias", size, [&]()
+            { wheel.build(selection.probability); },
+            [&](double r)
+            { return wheel.pick(r); });
+    }
+    return 0;
+}
+
+// The one-point order crossover as the drivers first wrote it, with nested
+// finds: kept as the reference order_crossover must reproduce.
+template <typename Idx>
+static void order_crossover_find(const Idx *first, const Idx *second, Idx *child, int n, int cut)
+{
+    for (int k = 0; k < cut; k++)
+        child[k] = first[k];
+    for (int k = cut; k < n; k++)
+    {
+        if (find(&child[0], &child[k], second[k]) == &child[k])
+        {
+            child[k] = second[k];
+        }
+        else
+        {
+            for (int l = 0; l < k; l++)
+            {
+                if (find(&child[0], &child[k], second[l]) == &child[k])
+                {
+                    child[k] = second[l];
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// count random tours of 1..n, the same for the same n.
+template <typename Idx>
+static vector<vector<Idx>> random_tours(int count, int n)
+{
+    vector<vector<Idx>> tours(count, vector<Idx>(n));
+    mt19937 rng(n);
+    for (auto &tour : tours)
+    {
+        iota(tour.begin(), tour.end(), 1);
+        shuffle(tour.begin(), tour.end(), rng);
+    }
+    return tours;
+}
+
+// Children per second of one crossover over random parents; stops after a
+// second.
+template <typename Idx, typename Cross>
+static void time_crossover(const char *label, int n, Cross cross)
+{
+    vector<vector<Idx>> parents = random_tours<Idx>(16, n);
+    vector<Idx> child(n);
+    long children = 0, check = 0;
+    double sec = 0;
+    auto start = chrono::steady_clock::now();
+    while (sec < 1)
+    {
+        for (int c = 0; c < 16; c++)
+        {
+            cross(parents[c].data(), parents[(c + 1) % 16].data(), child.data(), n);
+            check += child[n / 2];
+        }
+        children += 16;
+        sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    printf("  %-8s %12.0f children/s  (check %ld)\n", label, children / sec, check / children);
+}
+
+// crossover: checks that order_crossover builds the same child as the
+// nested-find reference on random parents and cuts, then times both.
+static int bench_crossover(int argc, char **argv)
+{
+    vector<int> sizes;
+    for (int a = 1; a < argc; a++)
+        sizes.push_back(stoi(argv[a]));
+    if (sizes.empty())
+        sizes = {48, 1000, 5000};
+    int failed = 0;
+    for (int n : sizes)
+    {
+        with_index(n, [&](auto idx)
+                   {
+                       typedef decltype(idx) Idx;
+                       mt19937 rng(n);
+                       vector<Idx> first(n), second(n), expected(n), child(n);
+                       iota(first.begin(), first.end(), 1);
+                       iota(second.begin(), second.end(), 1);
+                       int mismatches = 0, trials = max(10, 20000000 / (n * n));
+                       for (int t = 0; t < trials; t++)
+                       {
+                           shuffle(first.begin(), first.end(), rng);
+                           shuffle(second.begin(), second.end(), rng);
+                           int cut = rng() % (n - 1);
+                           order_crossover_find(first.data(), second.data(), expected.data(), n, cut);
+                           order_crossover(first.data(), second.data(), child.data(), n, cut);
+                           mismatches += expected != child;
+                       }
+                       printf("%d cities: %d/%d children differ from the reference\n", n, mismatches, trials);
+                       failed += mismatches;
+                       time_crossover<Idx>("find", n, [](const Idx *first, const Idx *second, Idx *child, int n)
+                                           { order_crossover_find(first, second, child, n, random_below(n - 1)); });
+                       time_crossover<Idx>("stamps", n, ox_crossover<Idx>);
+                   });
+    }
+    return failed > 0;
+}
+
+static const char *const crossover_names[] = {"ox", "pmx", "cx", "erx", "ox2"};
+static const double quality_seconds = 2;
+
+// Number of the children of cross, out of 100 random pairs of parents, that
+// are not permutations of 1..n; reported under label when there are any.
+template <typename Idx, typename Cross>
+static int check_children(const char *label, int n, Cross cross)
+{
+    vector<vector<Idx>> parents = random_tours<Idx>(200, n);
+    vector<Idx> child(n);
+    int invalid = 0;
+    for (int t = 0; t < 100; t++)
+    {
+        cross(parents[2 * t].data(), parents[2 * t + 1].data(), child.data(), n);
+        vector<char> seen(n + 1, 0);
+        bool ok = true;
+        for (int k = 0; k < n; k++)
+        {
+            ok = ok && child[k] >= 1 && (int)child[k] <= n && !seen[child[k]];
+            if (ok)
+                seen[child[k]] = 1;
+        }
+        invalid += !ok;
+    }
+    if (invalid > 0)
+        printf("  %-4s %d/100 children are not tours\n", label, invalid);
+    return invalid;
+}
+
+// A small steady-state GA that only differs in its crossover: 100 tours,
+// parents by binary tournament, 10% swap mutation, the child replacing its
+// first parent when it is shorter, which keeps the population diverse.
+// Every 64 children it calls watch(seconds, best length) and stops once
+// that returns false; returns the number of children.
+template <typename Idx, typename Dist, typename Cross, typename Watch>
+static long steady_ga(const Dist &dist, Cross cross, Watch watch)
+{
+    int n = dist.size();
+    const int size = 100;
+    seed_breeding_rng(1);
+    mt19937 rng(1);
+    vector<vector<Idx>> tours(size, vector<Idx>(n));
+    vector<length_t> length(size);
+    for (int t = 0; t < size; t++)
+    {
+        iota(tours[t].begin(), tours[t].end(), 1);
+        shuffle(tours[t].begin(), tours[t].end(), rng);
+        length[t] = tour_length(dist, tours[t].data(), n);
+    }
+    auto pick = [&]()
+    {
+        int a = rng() % size, b = rng() % size;
+        return length[a] < length[b] ? a : b;
+    };
+    vector<Idx> child(n);
+    long children = 0;
+    auto start = chrono::steady_clock::now();
+    while (true)
+    {
+        int a = pick(), b = pick();
+        cross(tours[a].data(), tours[b].data(), child.data(), n);
+        if (rng() % 10 == 0)
+            swap(child[rng() % n], child[rng() % n]);
+        length_t len = tour_length(dist, child.data(), n);
+        if (len < length[a])
+        {
+            tours[a].swap(child);
+            length[a] = len;
+        }
+        if (++children % 64 == 0)
+        {
+            double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (!watch(sec, *min_element(length.begin(), length.end())))
+                return children;
+        }
+    }
+}
+
+// Best tour of steady_ga after a quarter, a half and all of quality_seconds.
+template <typename Idx, typename Dist, typename Cross>
+static void time_quality(const char *label, const Dist &dist, Cross cross)
+{
+    length_t best[3];
+    int reached = 0;
+    double sec = 0;
+    long children = steady_ga<Idx>(dist, cross, [&](double now, length_t shortest)
+                                   {
+                                       sec = now;
+                                       while (reached < 3 && sec >= quality_seconds * (1 << reached) / 4)
+                                           best[reached++] = shortest;
+                                       return reached < 3;
+                                   });
+    printf("  %-4s %10.0f children/s in the GA  best %lld / %lld / %lld at %.1f / %.1f / %.1f s\n", label,
+           children / sec, (long long)best[0], (long long)best[1], (long long)best[2], quality_seconds / 4,
+           quality_seconds / 2, quality_seconds);
+}
+
+// Known optimal tour lengths of the bundled instances.
+static length_t known_optimum(const string &name)
+{
+    if (name == "att48")
+        return 10628;
+    if (name == "ch150")
+        return 6528;
+    if (name == "dsj1000")
+        return 18659688;
+    return 0;
+}
+
+// Loads each instance of paths, builds its table as options ask and its
+// candidate lists, and calls run(idx, dist, candidates, optimum), idx being
+// a value of the id type that fits the instance. optimum is 0 when the
+// instance has none in known_optimum; with need_optimum such instances are
+// skipped.
+template <typename Run>
+static void for_each_instance(const vector<const char *> &paths, const GaOptions &options, bool need_optimum,
+                              Run run)
+{
+    for (const char *path : paths)
+    {
+        TspInstance instance = load_tsp(path, 1);
+        length_t optimum = known_optimum(instance.name);
+        if (optimum == 0 && need_optimum)
+        {
+            fprintf(stderr, "%s: no known optimum\n", path);
+            continue;
+        }
+        CandidateLists candidates = build_candidates(instance, options.neighbors, 1);
+        TspCache cache;
+        if (optimum > 0)
+            printf("%s, %d cities, optimum %lld:\n", instance.name.c_str(), instance.dimension, (long long)optimum);
+        else
+            printf("%s, %d cities:\n", instance.name.c_str(), instance.dimension);
+        with_distance(
+            instance, options, cache, [](auto &dist, const auto &source)
+            {
+                for (long t = 0; t < matrix_tiles(dist.size()); t++)
+                    fill_tile(dist, source, t);
+            },
+            [&](const auto &dist)
+            {
+                with_index(dist.size(), [&](auto idx)
+                           { run(idx, dist, candidates, optimum); });
+            });
+    }
+}
+
+// operators: for every crossover operator, on each instance (the bundled
+// ones by default), checks that its children are tours, times it alone on
+// random parents and runs it in a small GA for quality_seconds.
+static int bench_operators(int argc, char **argv)
+{
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    vector<const char *> paths(argv + first, argv + argc);
+    if (paths.empty())
+        paths = {"att48.tsp", "ch150.tsp", "dsj1000.tsp"};
+    int failed = 0;
+    for_each_instance(paths, options, false, [&](auto idx, const auto &dist, const CandidateLists &, length_t)
+                      {
+                          typedef decltype(idx) Idx;
+                          for (const char *name : crossover_names)
+                          {
+                              CrossoverOperator<Idx> cross = crossover_operator<Idx>(name);
+                              failed += check_children<Idx>(name, dist.size(), cross);
+                              time_crossover<Idx>(name, dist.size(), cross);
+                              time_quality<Idx>(name, dist, cross);
+                          }
+                      });
+    return failed > 0;
+}
+
+static const double target_gaps[] = {0.5, 0.2, 0.1, 0.05, 0.02};
+
+// Seconds steady_ga takes to come within each of target_gaps of optimum,
+// giving up after limit seconds.
+template <typename Idx, typename Dist, typename Cross>
+static void time_to_gap(const char *label, const Dist &dist, Cross cross, length_t optimum, double limit)
+{
+    const int targets = sizeof(target_gaps) / sizeof(target_gaps[0]);
+    double reached_at[targets];
+    int reached = 0;
+    length_t best = 0;
+    long children = steady_ga<Idx>(dist, cross, [&](double now, length_t shortest)
+                                   {
+                                       best = shortest;
+                                       while (reached < targets && best <= optimum * (1 + target_gaps[reached]))
+                                           reached_at[reached++] = now;
+                                       return reached < targets && now < limit;
+                                   });
+    printf("  %-5s %8ld children, best %lld (%.1f%%):", label, children, (long long)best,
+           100.0 * (best - optimum) / optimum);
+    for (int g = 0; g < targets; g++)
+    {
+        if (g < reached)
+            printf("  %g%% at %.2f s", 100 * target_gaps[g], reached_at[g]);
+        else
+            printf("  %g%% -", 100 * target_gaps[g]);
+    }
+    printf("\n");
+}
+
+// eax: time for the steady-state GA to reach each target gap with the order
+// crossover and with EAX, on instances with a known optimum (ch150 and
+// dsj1000 by default), limit seconds at most per run.
+static int bench_eax(int argc, char **argv)
+{
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    double limit = argc - first > 0 ? stod(argv[first++]) : 30;
+    vector<const char *> paths(argv + first, argv + argc);
+    if (paths.empty())
+        paths = {"ch150.tsp", "dsj1000.tsp"};
+    int failed = 0;
+    for_each_instance(paths, options, true,
+                      [&](auto idx, const auto &dist, const CandidateLists &candidates, length_t optimum)
+                      {
+                          typedef decltype(idx) Idx;
+                          auto eax = [&](const Idx *first, const Idx *second, Idx *child, int n)
+                          { eax_crossover(dist, candidates, first, second, child, n); };
+                          failed += check_children<Idx>("eax", dist.size(), eax);
+                          time_to_gap<Idx>("ox", dist, ox_crossover<Idx>, optimum, limit);
+                          time_to_gap<Idx>("eax", dist, eax, optimum, limit);
+                      });
+    return failed > 0;
+}
+
+// Number of 100 random tours on which search, called as search(path, n),
+// does not return the change in tour length or leaves no permutation;
+// reported under label when there are any.
+template <typename Idx, typename Dist, typename Search>
+static int check_search(const char *label, const Dist &dist, Search search)
+{
+    int n = dist.size();
+    int wrong = 0;
+    for (vector<Idx> &tour : random_tours<Idx>(100, n))
+    {
+        length_t before = tour_length(dist, tour.data(), n);
+        length_t delta = search(tour.data(), n);
+        vector<Idx> sorted(tour);
+        sort(sorted.begin(), sorted.end());
+        bool ok = delta <= 0 && tour_length(dist, tour.data(), n) == before + delta;
+        for (int k = 0; k < n; k++)
+            ok = ok && (int)sorted[k] == k + 1;
+        wrong += !ok;
+    }
+    if (wrong > 0)
+        printf("  %s %d/100 searches are wrong\n", label, wrong);
+    return wrong;
+}
+
+// memetic: time for the steady-state GA to reach each target gap with the
+// order crossover alone and followed on every child by 2-opt, Or-opt and
+// both, each with the --search-moves budget of the drivers, on instances
+// with a known optimum (ch150 and dsj1000 by default), limit seconds at
+// most per run.
+static int bench_memetic(int argc, char **argv)
+{
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    double limit = argc - first > 0 ? stod(argv[first++]) : 30;
+    vector<const char *> paths(argv + first, argv + argc);
+    if (paths.empty())
+        paths = {"ch150.tsp", "dsj1000.tsp"};
+    int failed = 0;
+    for_each_instance(paths, options, true,
+                      [&](auto idx, const auto &dist, const CandidateLists &candidates, length_t optimum)
+                      {
+                          typedef decltype(idx) Idx;
+                          auto two = [&](Idx *path, int n)
+                          { return two_opt(dist, candidates, path, n, options.search_moves); };
+                          auto oro = [&](Idx *path, int n)
+                          { return or_opt(dist, candidates, path, n, options.search_moves); };
+                          failed += check_search<Idx>("2opt", dist, two);
+                          failed += check_search<Idx>("oropt", dist, oro);
+                          auto memetic = [&](bool with_two, bool with_or)
+                          {
+                              return [&, with_two, with_or](const Idx *first, const Idx *second, Idx *child, int n)
+                              {
+                                  ox_crossover(first, second, child, n);
+                                  if (with_two)
+                                      two(child, n);
+                                  if (with_or)
+                                      oro(child, n);
+                              };
+                          };
+                          time_to_gap<Idx>("ox", dist, ox_crossover<Idx>, optimum, limit);
+                          time_to_gap<Idx>("2opt", dist, memetic(true, false), optimum, limit);
+                          time_to_gap<Idx>("oropt", dist, memetic(false, true), optimum, limit);
+                          time_to_gap<Idx>("both", dist, memetic(true, true), optimum, limit);
+                      });
+    return failed > 0;
+}
+
+// Average length, gap to optimum and time per tour of search, called as
+// search(path, n), on 10 random tours, and the longest time of one call.
+template <typename Idx, typename Dist, typename Search>
+static void time_search(const char *label, const Dist &dist, Search search, length_t optimum)
+{
+    int n = dist.size();
+    const int tours = 10;
+    double total = 0, sec = 0, longest = 0;
+    for (vector<Idx> &tour : random_tours<Idx>(tours, n))
+    {
+        auto start = chrono::steady_clock::now();
+        search(tour.data(), n);
+        double took = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        sec += took;
+        longest = max(longest, took);
+        total += tour_length(dist, tour.data(), n);
+    }
+    printf("  %-10s %14.0f (%5.1f%%) %9.3f ms per tour, at most %.3f ms\n", label, total / tours,
+           100 * (total / tours - optimum) / optimum, 1000 * sec / tours, 1000 * longest);
+}
+
+// lk: lin_kernighan with a budget of ms milliseconds (10 by default) against
+// 2-opt followed by Or-opt, both run to a local optimum, from random tours
+// of instances with a known optimum (ch150 and dsj1000 by default).
+static int bench_lk(int argc, char **argv)
+{
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    double seconds = (argc - first > 0 ? stod(argv[first++]) : 10) / 1000;
+    vector<const char *> paths(argv + first, argv + argc);
+    if (paths.empty())
+        paths = {"ch150.tsp", "dsj1000.tsp"};
+    int failed = 0;
+    for_each_instance(paths, options, true,
+                      [&](auto idx, const auto &dist, const CandidateLists &candidates, length_t optimum)
+                      {
+                          typedef decltype(idx) Idx;
+                          auto lk = [&](Idx *path, int n)
+                          { return lin_kernighan(dist, candidates, path, n, seconds); };
+                          auto both = [&](Idx *path, int n)
+                          {
+                              return two_opt(dist, candidates, path, n, local_optimum_moves) +
+                                     or_opt(dist, candidates, path, n, local_optimum_moves);
+                          };
+                          failed += check_search<Idx>("lk", dist, lk);
+                          time_search<Idx>("2opt+oropt", dist, both, optimum);
+                          time_search<Idx>("lk", dist, lk, optimum);
+                      });
+    return failed > 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reorder") == 0)
+        return bench_reorder(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "tour") == 0)
+        return bench_tour(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "select") == 0)
+        return bench_select(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "crossover") == 0)
+        return bench_crossover(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "operators") == 0)
+        return bench_operators(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "eax") == 0)
+        return bench_eax(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "memetic") == 0)
+        return bench_memetic(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "lk") == 0)
+        return bench_lk(argc - 1, argv + 1);
+    printf("Usage: ga_tsp_bench reorder [options] <tsp_file_path> [tours]\n");
+    printf("       ga_tsp_bench tour [cities...]\n");
+    printf("       ga_tsp_bench select [population sizes...]\n");
+    printf("       ga_tsp_bench crossover [cities...]\n");
+    printf("       ga_tsp_bench operators [options] [tsp_file_path...]\n");
+    printf("       ga_tsp_bench eax [options] [seconds] [tsp_file_path...]\n");
+    printf("       ga_tsp_bench memetic [options] [seconds] [tsp_file_path...]\n");
+    printf("       ga_tsp_bench lk [options] [ms] [tsp_file_path...]\n");
+    return 0;
+}
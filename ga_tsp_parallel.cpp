@@ -7,6 +7,15 @@
 #include <algorithm>
 #include <iterator>
 #include "utimer.hpp"
+#include "tsp_loader.hpp"
+#include "ga_options.hpp"
+#include "distance.hpp"
+#include "population.hpp"
+#include "mutation.hpp"
+#include "selection.hpp"
+#include "crossover.hpp"
+#include "eax.hpp"
+#include "local_search.hpp"
 #include <chrono>
 #include <thread>
 #include <barrier>
@@ -19,152 +28,114 @@ using namespace std;
 int tot_cities;
 int population_size;
 int iterations;
-float **dist_matrix;
+vector<int> city_ids;
+CandidateLists candidates;
 int nw;
 mutex m;
 condition_variable cv;
-condition_variable cv2;
-condition_variable cv3;
 bool go = false;
-bool go_copy = false;
-bool go_fitness = false;
+// Elites the workers improve this generation, set by the main thread between
+// the breeding and the elite phase.
+int elites;
 vector<thread> pool;
 mutex *mutexes;
 
-struct City
-{
-    int id;
-    float x;
-    float y;
-};
+template <typename Idx>
+PopulationArena<Idx> arena;
+template <typename Idx>
+vector<Chromosome<Idx>> population;
+template <typename Idx>
+vector<Chromosome<Idx>> temp_children;
+vector<RankKey> ranking;
+SelectionWeights selection;
+const char *crossover_name;
+template <typename Idx>
+CrossoverOperator<Idx> crossover;
+bool edge_assembly;
+MutationRates rates;
+bool two_opt_search;
+bool or_opt_search;
+int search_moves;
+int lk_elites;
+double lk_seconds;
 
-struct Chromosome
+// Runs f(b) for b in [0, count), each block on its own thread. The pool
+// holds the breeding workers by then, so these threads are separate.
+struct ThreadBlocks
 {
-    vector<int> path;
-    float fitness;
-    Chromosome(int n)
+    template <typename F>
+    void operator()(int count, F f) const
     {
-        this->path = vector<int>(n);
-    };
+        vector<thread> scan;
+        for (int b = 1; b < count; b++)
+            scan.push_back(thread(f, b));
+        f(0);
+        for (auto &t : scan)
+            t.join();
+    }
 };
 
-City *cities;
-vector<Chromosome> population;
-vector<Chromosome> temp_children;
-
-void create_dist_matrix(char *file_path)
+template <typename Dist, typename Source>
+void fill_tiles(Dist &dist, const Source &source, int id)
 {
-    int id;
-    char buf[1024];
-    float x, y;
-    ifstream file(file_path);
-    string line;
-    bool start_data = false;
-    while (getline(file, line))
-    {
-        if (line.find("EOF") != string::npos)
-        {
-            start_data = false;
-        }
-        else if (start_data)
-        {
-            int id = stoi(line.substr(0, line.find(" ")));
-            cities[id - 1].id = id;
-            line = line.erase(0, line.find(" ") + 1);
-            cities[id - 1].x = stof(line.substr(0, line.find(" ")));
-            line = line.erase(0, line.find(" ") + 1);
-            cities[id - 1].y = stof(line);
-        }
-        else if ((line.find("DIMENSION")) != string::npos)
-        {
-            tot_cities = stoi(line.substr(line.find(": ") + 2));
-            cities = (City *)malloc(sizeof(City) * tot_cities);
-        }
-        else if (line.find("NODE_COORD_SECTION") != string::npos)
-        {
-            start_data = true;
-        }
-    }
-    dist_matrix = (float **)malloc(sizeof(float *) * tot_cities);
-    for (int i = 0; i < tot_cities; i++)
-        dist_matrix[i] = (float *)calloc(tot_cities, sizeof(float));
-    for (int i = 0; i < tot_cities - 1; i++)
+    long tiles = matrix_tiles(tot_cities);
+    for (long t = id; t < tiles; t += nw)
     {
-        for (int j = i + 1; j < tot_cities; j++)
-        {
-            float distance = sqrt(pow(cities[i].x - cities[j].x, 2) + pow(cities[i].y - cities[j].y, 2));
-            dist_matrix[i][j] = dist_matrix[j][i] = distance;
-        }
+        fill_tile(dist, source, t);
     }
-    free(cities);
 }
 
-void calculate_fitness(Chromosome *c)
+template <typename Dist, typename Source>
+void create_dist_matrix(Dist &dist, const Source &source)
 {
-    float distance = 0;
-    for (int i = 0; i < tot_cities - 1; i++)
+    for (int i = 0; i < nw; i++)
     {
-        if (c->path[i] - 1 < 0 || c->path[i] - 1 >= tot_cities || c->path[i + 1] - 1 < 0 || c->path[i + 1] - 1 >= tot_cities)
-        {
-            for (int j = 0; j < tot_cities; j++)
-            {
-                cout << c->path[j] << ", ";
-            }
-        }
-        distance += dist_matrix[c->path[i] - 1][c->path[i + 1] - 1];
+        pool.push_back(thread(fill_tiles<Dist, Source>, ref(dist), cref(source), i));
     }
-    distance += dist_matrix[c->path[tot_cities - 1] - 1][c->path[0] - 1];
-    c->fitness = 1 / distance;
+    for (int i = 0; i < nw; i++)
+    {
+        pool[i].join();
+    }
+    pool.clear();
 }
 
-bool sort_by_fitness(const Chromosome &c1, const Chromosome &c2)
+template <typename Idx, typename Dist>
+void calculate_fitness(Chromosome<Idx> *c, const Dist &dist)
 {
-    return c1.fitness > c2.fitness;
+    c->length = tour_length(dist, &c->path[0], tot_cities);
 }
 
-void init_population(int start, int end)
+template <typename Idx, typename Dist>
+void init_population(int start, int end, const Dist &dist)
 {
     for (int i = start; i < end; i++)
     {
-        iota(population[i].path.begin(), population[i].path.end(), 1);
-        random_shuffle(population[i].path.begin(), population[i].path.end());
-        calculate_fitness(&population[i]);
-    }
-    for (int i = start / 2; i < end / 2; i++)
-    {
-        fill(temp_children[i].path.begin(), temp_children[i].path.end(), 0);
+        iota(population<Idx>[i].path, population<Idx>[i].path + tot_cities, 1);
+        shuffle(population<Idx>[i].path, population<Idx>[i].path + tot_cities, breeding_rng());
+        calculate_fitness(&population<Idx>[i], dist);
     }
 }
 
-void sort_and_normalize()
+template <typename Idx, typename Policy>
+void rank_and_normalize(Policy &policy)
 {
-    sort(population.begin(), population.end(), sort_by_fitness);
-    float sum = 0;
-    for (int i = 0; i < population_size; i++)
-    {
-        sum += population[i].fitness;
-    }
-    for (int i = 0; i < population_size; i++)
+    if constexpr (Policy::ranked)
     {
-        population[i].fitness /= sum;
+        float sum = rank_population(population<Idx>, selection, ranking);
+        normalize_selection(selection, sum, nw, ThreadBlocks());
     }
-}
-
-void mutate()
-{
-    for (int n = 0; n < population_size / 10; n++)
+    else
     {
-        int best = population_size / 4;
-        int i = rand() % tot_cities;
-        int j = rand() % tot_cities;
-        int k = rand() % (population_size - best);
-        int temp = population[best + k].path[i];
-        population[best + k].path[i] = population[best + k].path[j];
-        population[best + k].path[j] = temp;
+        rank_elites(population<Idx>, ranking, random_below(population_size), nw, ThreadBlocks());
     }
+    policy.prepare(ranking, selection);
 }
 
-void select_and_breed(int start, int end, barrier<void (*)()> &b, barrier<void (*)()> &b2, barrier<void (*)()> &b3)
+// Breeds the children of [start, end) each generation. With lk_elites the
+// pool then also improves the elites id, id + nw, ... once the main thread
+// has ranked the population; each of these steps ends at the barrier.
+template <typename Idx, typename Dist, typename Policy>
+void select_and_breed(int id, int start, int end, barrier<void (*)()> &b, const Dist &dist, const Policy &policy)
 {
     try
     {
@@ -177,66 +148,27 @@ void select_and_breed(int start, int end, barrier<void (*)()> &b, barrier<void (
             }
             for (int i = start / 2; i < end / 2; i++)
             {
-                float temp_fitness = 0;
-                float r = ((float)rand()) / (RAND_MAX);
-                for (int j = 0; j < population_size; j++)
-                {
-                    temp_fitness += population[j].fitness;
-                    if (temp_fitness > r && i != j)
-                    {
-                        Chromosome *child = &temp_children[i];
-                        int n = rand() % (tot_cities - 1);
-                        int k = 0;
-                        for (k = 0; k < n; k++)
-                        {
-                            child->path[k] = population[i].path[k];
-                        }
-                        int lseen = 0;
-                        for (k = n; k < tot_cities; k++)
-                        {
-                            if (find(&child->path[0], &child->path[k], population[j].path[k]) == &child->path[k])
-                            {
-                                child->path[k] = population[j].path[k];
-                            }
-                            else
-                            {
-                                for (int l = lseen; l < k; l++)
-                                {
-                                    if (find(&child->path[0], &child->path[k], population[j].path[l]) == &child->path[k])
-                                    {
-                                        child->path[k] = population[j].path[l];
-                                        lseen = l;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        calculate_fitness(child);
-                        break;
-                    }
-                }
+                int parent = policy.parent(population<Idx>, i);
+                int j = policy.mate(population<Idx>, i, parent);
+                Chromosome<Idx> *child = &temp_children<Idx>[i];
+                if (edge_assembly)
+                    eax_crossover(dist, candidates, population<Idx>[parent].path, population<Idx>[j].path, child->path, tot_cities);
+                else
+                    crossover<Idx>(population<Idx>[parent].path, population<Idx>[j].path, child->path, tot_cities);
+                calculate_fitness(child, dist);
+                child->length += mutate_tour(dist, child->path, tot_cities, rates);
+                if (two_opt_search)
+                    child->length += two_opt(dist, candidates, child->path, tot_cities, search_moves);
+                if (or_opt_search)
+                    child->length += or_opt(dist, candidates, child->path, tot_cities, search_moves);
             }
             b.arrive_and_wait();
+            if (lk_elites > 0)
             {
-                unique_lock lock(m);
-                cv2.wait(lock, []()
-                         { return go_copy; });
-            }
-            for (int i = start / 2; i < end / 2; i++)
-            {
-                population[(population_size / 2) + i] = temp_children[i];
-            }
-            b2.arrive_and_wait();
-            {
-                unique_lock lock(m);
-                cv3.wait(lock, []()
-                         { return go_fitness; });
+                b.arrive_and_wait();
+                improve_elite_block(population<Idx>, ranking, elites, id, nw, dist, candidates, tot_cities, lk_seconds);
+                b.arrive_and_wait();
             }
-            for (int i = start / 2; i < end / 2; i++)
-            {
-                calculate_fitness(&population[(population_size / 2) + i]);
-            }
-            b3.arrive_and_wait();
         }
     }
     catch (const std::exception &e)
@@ -245,32 +177,12 @@ void select_and_breed(int start, int end, barrier<void (*)()> &b, barrier<void (
     }
 }
 
-int main(int argc, char **argv)
+template <typename Idx, typename Dist, typename Policy>
+void run_ga(const Dist &dist, Policy &policy)
 {
-    utimer t("ALL: ");
-    if (argc < 5)
-    {
-        printf("Usage: ga_tsp_sequential <tsp_file_path> <populazion_size> <iterations> <nw>\n");
-        exit(0);
-    }
-    population_size = stoi(argv[2]);
-    iterations = stoi(argv[3]);
-    nw = stoi(argv[4]) - 1;
-    int max_nw = thread::hardware_concurrency() - 1;
-    if (nw > max_nw)
-    {
-        nw = max_nw;
-    }
-    create_dist_matrix(argv[1]);
-    for (int i = 0; i < population_size; i++)
-    {
-        population.push_back(Chromosome(tot_cities));
-        if (i < population_size / 2)
-        {
-            temp_children.push_back(Chromosome(tot_cities));
-        }
-    }
-    srand(time(NULL));
+    utimer t("GA: ");
+    crossover<Idx> = crossover_operator<Idx>(crossover_name);
+    arena_population(arena<Idx>, population<Idx>, temp_children<Idx>, population_size, tot_cities);
     int tsize = population_size / nw;
     int remainder = population_size % nw;
     int end = 0;
@@ -284,24 +196,20 @@ int main(int argc, char **argv)
     }
     for (int i = 0; i < nw; i++)
     {
-        pool.push_back(thread(init_population, divisions[i], divisions[i + 1]));
+        pool.push_back(thread(init_population<Idx, Dist>, divisions[i], divisions[i + 1], cref(dist)));
     }
     for (int i = 0; i < nw; i++)
     {
         pool[i].join();
     }
     pool.clear();
-    sort_and_normalize();
+    rank_and_normalize<Idx>(policy);
     mutexes = (mutex *)malloc(population_size * sizeof(mutex));
     barrier<void (*)()> b(nw + 1, []()
                           { go = false; });
-    barrier<void (*)()> b2(nw + 1, []()
-                           { go_copy = false; });
-    barrier<void (*)()> b3(nw + 1, []()
-                           { go_fitness = false; });
     for (int i = 0; i < nw; i++)
     {
-        pool.push_back(thread(select_and_breed, divisions[i], divisions[i + 1], ref(b), ref(b2), ref(b3)));
+        pool.push_back(thread(select_and_breed<Idx, Dist, Policy>, i, divisions[i], divisions[i + 1], ref(b), cref(dist), cref(policy)));
     }
     for (int iter = 0; iter < iterations; iter++)
     {
@@ -311,31 +219,71 @@ int main(int argc, char **argv)
             cv.notify_all();
         }
         b.arrive_and_wait();
+        replace_with_children(population<Idx>, ranking, temp_children<Idx>);
+        rank_and_normalize<Idx>(policy);
+        if (lk_elites > 0)
         {
-            unique_lock lock2(m);
-            go_copy = true;
-            cv2.notify_all();
-        }
-        b2.arrive_and_wait();
-        mutate();
-        {
-            unique_lock lock3(m);
-            go_fitness = true;
-            cv3.notify_all();
+            elites = sort_elites(ranking, lk_elites);
+            b.arrive_and_wait();
+            b.arrive_and_wait();
         }
-        b3.arrive_and_wait();
-        sort_and_normalize();
     }
     for (int i = 0; i < nw; i++)
     {
         pool[i].join();
     }
+    rank_best(ranking, 10);
     for (int i = 0; i < 10; i++)
     {
         for (int j = 0; j < tot_cities; j++)
         {
-            cout << population[i].path[j] << ", ";
+            cout << city_label(city_ids, population<Idx>[ranking[i].slot].path[j]) << ", ";
         }
-        cout << "- " << 1 / population[i].fitness << endl;
+        cout << "- " << population<Idx>[ranking[i].slot].length << endl;
     }
+}
+
+int main(int argc, char **argv)
+{
+    utimer t("ALL: ");
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    if (argc - first < 4)
+    {
+        printf("Usage: ga_tsp_sequential %s <tsp_file_path> <populazion_size> <iterations> <nw>\n", ga_options_usage);
+        exit(0);
+    }
+    population_size = stoi(argv[first + 1]);
+    iterations = stoi(argv[first + 2]);
+    // Workers beside the main thread: at least one, even for "1" or on a
+    // single core, and at most one per remaining core.
+    nw = max(1, min(stoi(argv[first + 3]) - 1, (int)thread::hardware_concurrency() - 1));
+    TspCache cache;
+    TspInstance instance = load_instance(argv[first], options, nw, &cache);
+    tot_cities = instance.dimension;
+    city_ids = instance.ids;
+    crossover_name = options.crossover;
+    edge_assembly = strcmp(options.crossover, "eax") == 0;
+    rates = {options.swap_rate, options.inversion_rate, options.insertion_rate, options.scramble_rate};
+    two_opt_search = strncmp(options.local_search, "2opt", 4) == 0;
+    or_opt_search = strstr(options.local_search, "oropt") != NULL;
+    search_moves = options.search_moves;
+    lk_elites = options.lk_elites;
+    lk_seconds = options.lk_ms / 1000.0;
+    {
+        utimer t("CAND: ");
+        load_candidates(instance, options, nw, &cache, &candidates);
+    }
+    with_distance(
+        instance, options, cache, [](auto &dist, const auto &source)
+        {
+            utimer t("DIST: ");
+            create_dist_matrix(dist, source);
+        },
+        [&](const auto &dist)
+        {
+            with_index(tot_cities, [&](auto idx)
+                       { with_selection(options, [&](auto &policy)
+                                        { run_ga<decltype(idx)>(dist, policy); }); });
+        });
 }
\ No newline at end of file
@@ -7,6 +7,15 @@
 #include <algorithm>
 #include <iterator>
 #include "utimer.hpp"
+#include "tsp_loader.hpp"
+#include "ga_options.hpp"
+#include "distance.hpp"
+#include "population.hpp"
+#include "mutation.hpp"
+#include "selection.hpp"
+#include "crossover.hpp"
+#include "eax.hpp"
+#include "local_search.hpp"
 #include <chrono>
 #include <thread>
 #include <vector>
@@ -16,217 +25,155 @@ using namespace std;
 int tot_cities;
 int population_size;
 int iterations;
-float **dist_matrix;
+vector<int> city_ids;
+CandidateLists candidates;
 
-struct City
-{
-    int id;
-    float x;
-    float y;
-};
+template <typename Idx>
+PopulationArena<Idx> arena;
+template <typename Idx>
+vector<Chromosome<Idx>> population;
+template <typename Idx>
+vector<Chromosome<Idx>> temp_children;
+vector<RankKey> ranking;
+SelectionWeights selection;
+const char *crossover_name;
+template <typename Idx>
+CrossoverOperator<Idx> crossover;
+bool edge_assembly;
+MutationRates rates;
+bool two_opt_search;
+bool or_opt_search;
+int search_moves;
+int lk_elites;
+double lk_seconds;
 
-struct Chromosome
+template <typename Dist, typename Source>
+void create_dist_matrix(Dist &dist, const Source &source)
 {
-    vector<int> path;
-    float fitness;
-    Chromosome(int n)
+    long tiles = matrix_tiles(tot_cities);
+    for (long t = 0; t < tiles; t++)
     {
-        this->path = vector<int>(n);
-    };
-};
-
-City *cities;
-vector<Chromosome> population;
-vector<Chromosome> temp_children;
-
-void create_dist_matrix(char *file_path)
-{
-    int id;
-    char buf[1024];
-    float x, y;
-    ifstream file(file_path);
-    string line;
-    bool start_data = false;
-    while (getline(file, line))
-    {
-        if (line.find("EOF") != string::npos)
-        {
-            start_data = false;
-        }
-        else if (start_data)
-        {
-            int id = stoi(line.substr(0, line.find(" ")));
-            cities[id - 1].id = id;
-            line = line.erase(0, line.find(" ") + 1);
-            cities[id - 1].x = stof(line.substr(0, line.find(" ")));
-            line = line.erase(0, line.find(" ") + 1);
-            cities[id - 1].y = stof(line);
-        }
-        else if ((line.find("DIMENSION")) != string::npos)
-        {
-            tot_cities = stoi(line.substr(line.find(": ") + 2));
-            cities = (City *)malloc(sizeof(City) * tot_cities);
-        }
-        else if (line.find("NODE_COORD_SECTION") != string::npos)
-        {
-            start_data = true;
-        }
+        fill_tile(dist, source, t);
     }
-    dist_matrix = (float **)malloc(sizeof(float *) * tot_cities);
-    for (int i = 0; i < tot_cities; i++)
-        dist_matrix[i] = (float *)calloc(tot_cities, sizeof(float));
-    for (int i = 0; i < tot_cities - 1; i++)
-    {
-        for (int j = i + 1; j < tot_cities; j++)
-        {
-            float distance = sqrt(pow(cities[i].x - cities[j].x, 2) + pow(cities[i].y - cities[j].y, 2));
-            dist_matrix[i][j] = dist_matrix[j][i] = distance;
-        }
-    }
-    free(cities);
-}
-
-void calculate_fitness(Chromosome *c)
-{
-    float distance = 0;
-    for (int i = 0; i < tot_cities - 1; i++)
-    {
-        distance += dist_matrix[c->path[i] - 1][c->path[i + 1] - 1];
-    }
-    distance += dist_matrix[c->path[tot_cities - 1] - 1][c->path[0] - 1];
-    c->fitness = 1 / distance;
 }
 
-bool sort_by_fitness(const Chromosome &c1, const Chromosome &c2)
+template <typename Idx, typename Dist>
+void calculate_fitness(Chromosome<Idx> *c, const Dist &dist)
 {
-    return c1.fitness > c2.fitness;
+    c->length = tour_length(dist, &c->path[0], tot_cities);
 }
 
-void sort_and_normalize()
+template <typename Idx, typename Policy>
+void rank_and_normalize(Policy &policy)
 {
-    sort(population.begin(), population.end(), sort_by_fitness);
-    float sum = 0;
-    for (int i = 0; i < population_size; i++)
+    if constexpr (Policy::ranked)
     {
-        sum += population[i].fitness;
+        float sum = rank_population(population<Idx>, selection, ranking);
+        normalize_selection(selection, sum, 1, SerialBlocks());
     }
-    for (int i = 0; i < population_size; i++)
+    else
     {
-        population[i].fitness /= sum;
+        rank_elites(population<Idx>, ranking, random_below(population_size), 1, SerialBlocks());
     }
+    policy.prepare(ranking, selection);
 }
 
-void init_population()
+template <typename Idx, typename Dist, typename Policy>
+void init_population(const Dist &dist, Policy &policy)
 {
-    int temp_path[tot_cities];
-    for (int i = 0; i < tot_cities; i++)
-    {
-        temp_path[i] = i + 1;
-    }
+    arena_population(arena<Idx>, population<Idx>, temp_children<Idx>, population_size, tot_cities);
     for (int i = 0; i < population_size; i++)
     {
-        population.push_back(Chromosome(tot_cities));
-        iota(population[i].path.begin(), population[i].path.end(), 1);
-        random_shuffle(population[i].path.begin(), population[i].path.end());
-        calculate_fitness(&population[i]);
-    }
-    for (int i = 0; i < population_size / 2; i++)
-    {
-        temp_children.push_back(Chromosome(tot_cities));
-        fill(temp_children[i].path.begin(), temp_children[i].path.end(), 0);
+        iota(population<Idx>[i].path, population<Idx>[i].path + tot_cities, 1);
+        shuffle(population<Idx>[i].path, population<Idx>[i].path + tot_cities, breeding_rng());
+        calculate_fitness(&population<Idx>[i], dist);
     }
-    sort_and_normalize();
+    rank_and_normalize<Idx>(policy);
 }
 
-void select_and_breed()
+template <typename Idx, typename Dist, typename Policy>
+void select_and_breed(const Dist &dist, const Policy &policy)
 {
     for (int i = 0; i < population_size / 2; i++)
     {
-        float temp_fitness = 0;
-        float r = ((float)rand()) / (RAND_MAX);
-        for (int j = 0; j < population_size; j++)
-        {
-            temp_fitness += population[j].fitness;
-            if (temp_fitness > r && i != j)
-            {
-                Chromosome *child = &temp_children[i];
-                int n = rand() % (tot_cities - 1);
-                int k = 0;
-                for (k = 0; k < n; k++)
-                {
-                    child->path[k] = population[i].path[k];
-                }
-                for (k = n; k < tot_cities; k++)
-                {
-                    if (find(&child->path[0], &child->path[k], population[j].path[k]) == &child->path[k])
-                    {
-                        child->path[k] = population[j].path[k];
-                    }
-                    else
-                    {
-                        for (int l = 0; l < k; l++)
-                        {
-                            if (find(&child->path[0], &child->path[k], population[j].path[l]) == &child->path[k])
-                            {
-                                child->path[k] = population[j].path[l];
-                                break;
-                            }
-                        }
-                    }
-                }
-                break;
-            }
-        }
-    }
-    for (int i = 0; i < population_size / 2; i++)
-    {
-        population[(population_size / 2) + i] = temp_children[i];
+        int parent = policy.parent(population<Idx>, i);
+        int j = policy.mate(population<Idx>, i, parent);
+        Chromosome<Idx> *child = &temp_children<Idx>[i];
+        if (edge_assembly)
+            eax_crossover(dist, candidates, population<Idx>[parent].path, population<Idx>[j].path, child->path, tot_cities);
+        else
+            crossover<Idx>(population<Idx>[parent].path, population<Idx>[j].path, child->path, tot_cities);
+        calculate_fitness(child, dist);
+        child->length += mutate_tour(dist, child->path, tot_cities, rates);
+        if (two_opt_search)
+            child->length += two_opt(dist, candidates, child->path, tot_cities, search_moves);
+        if (or_opt_search)
+            child->length += or_opt(dist, candidates, child->path, tot_cities, search_moves);
     }
+    replace_with_children(population<Idx>, ranking, temp_children<Idx>);
 }
 
-void mutate()
+template <typename Idx, typename Dist, typename Policy>
+void run_ga(const Dist &dist, Policy &policy)
 {
-    for (int n = 0; n < population_size / 10; n++)
+    utimer t("GA: ");
+    crossover<Idx> = crossover_operator<Idx>(crossover_name);
+    init_population<Idx>(dist, policy);
+    for (int iter = 0; iter < iterations; iter++)
     {
-        int best = population_size / 4;
-        int i = rand() % tot_cities;
-        int j = rand() % tot_cities;
-        int k = rand() % (population_size - best);
-        int temp = population[best + k].path[i];
-        population[best + k].path[i] = population[best + k].path[j];
-        population[best + k].path[j] = temp;
+        select_and_breed<Idx>(dist, policy);
+        rank_and_normalize<Idx>(policy);
+        improve_elites(population<Idx>, ranking, lk_elites, dist, candidates, tot_cities, lk_seconds, 1, SerialBlocks());
+    }
+    rank_best(ranking, 10);
+    for (int i = 0; i < 10; i++)
+    {
+        for (int j = 0; j < tot_cities; j++)
+        {
+            cout << city_label(city_ids, population<Idx>[ranking[i].slot].path[j]) << ", ";
+        }
+        cout << "- " << population<Idx>[ranking[i].slot].length << endl;
     }
 }
 
 int main(int argc, char **argv)
 {
     utimer t("ALL: ");
-    if (argc < 4)
+    GaOptions options;
+    int first = parse_options(argc, argv, &options);
+    if (argc - first < 3)
     {
-        printf("Usage: ga_tsp_sequential <tsp_file_path> <populazion_size> <iterations>\n");
+        printf("Usage: ga_tsp_sequential %s <tsp_file_path> <populazion_size> <iterations>\n", ga_options_usage);
         exit(0);
     }
-    population_size = stoi(argv[2]);
-    iterations = stoi(argv[3]);
-    create_dist_matrix(argv[1]);
-    srand(time(NULL));
-    init_population();
-    for (int iter = 0; iter < iterations; iter++)
+    population_size = stoi(argv[first + 1]);
+    iterations = stoi(argv[first + 2]);
+    TspCache cache;
+    TspInstance instance = load_instance(argv[first], options, 1, &cache);
+    tot_cities = instance.dimension;
+    city_ids = instance.ids;
+    crossover_name = options.crossover;
+    edge_assembly = strcmp(options.crossover, "eax") == 0;
+    rates = {options.swap_rate, options.inversion_rate, options.insertion_rate, options.scramble_rate};
+    two_opt_search = strncmp(options.local_search, "2opt", 4) == 0;
+    or_opt_search = strstr(options.local_search, "oropt") != NULL;
+    search_moves = options.search_moves;
+    lk_elites = options.lk_elites;
+    lk_seconds = options.lk_ms / 1000.0;
     {
-        select_and_breed();
-        mutate();
-        for (int i = 0; i < population_size / 2; i++)
-        {
-            calculate_fitness(&population[(population_size / 2) + i]);
-        }
-        sort_and_normalize();
+        utimer t("CAND: ");
+        load_candidates(instance, options, 1, &cache, &candidates);
     }
-    for (int i = 0; i < 10; i++)
-    {
-        for (int j = 0; j < tot_cities; j++)
+    with_distance(
+        instance, options, cache, [](auto &dist, const auto &source)
         {
-            cout << population[i].path[j] << ", ";
-        }
-        cout << "- " << 1 / population[i].fitness << endl;
-    }
+            utimer t("DIST: ");
+            create_dist_matrix(dist, source);
+        },
+        [&](const auto &dist)
+        {
+            with_index(tot_cities, [&](auto idx)
+                       { with_selection(options, [&](auto &policy)
+                                        { run_ga<decltype(idx)>(dist, policy); }); });
+        });
 }
\ No newline at end of file
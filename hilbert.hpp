@@ -0,0 +1,91 @@
+#ifndef HILBERT_HPP
+#define HILBERT_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "tsp_loader.hpp"
+
+static const int curve_order = 16;
+
+static inline uint64_t hilbert_index(uint32_t x, uint32_t y)
+{
+    const uint32_t n = 1u << curve_order;
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+static inline uint64_t morton_index(uint32_t x, uint32_t y)
+{
+    uint64_t d = 0;
+    for (int b = 0; b < curve_order; b++)
+        d |= (uint64_t)((x >> b) & 1) << (2 * b) | (uint64_t)((y >> b) & 1) << (2 * b + 1);
+    return d;
+}
+
+// Relabels the cities in the order a Hilbert or Morton curve over their
+// bounding box visits them, so cities that are close in space get close ids
+// and close rows of the distance table. instance.ids keeps the file id of
+// every new label. Instances without coordinates, or already renumbered
+// (e.g. loaded from a cache), are left as they are.
+static void curve_renumber(TspInstance &instance, const char *curve)
+{
+    int n = instance.dimension;
+    if (strcmp(curve, "none") == 0 || instance.x.empty() || !instance.ids.empty())
+        return;
+    double min_x = instance.x[0], max_x = instance.x[0], min_y = instance.y[0], max_y = instance.y[0];
+    for (int i = 1; i < n; i++)
+    {
+        min_x = std::min(min_x, instance.x[i]);
+        max_x = std::max(max_x, instance.x[i]);
+        min_y = std::min(min_y, instance.y[i]);
+        max_y = std::max(max_y, instance.y[i]);
+    }
+    double cells = (1u << curve_order) - 1;
+    double scale_x = max_x > min_x ? cells / (max_x - min_x) : 0;
+    double scale_y = max_y > min_y ? cells / (max_y - min_y) : 0;
+    bool hilbert = strcmp(curve, "hilbert") == 0;
+    std::vector<std::pair<uint64_t, int>> keys(n);
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t cx = (uint32_t)((instance.x[i] - min_x) * scale_x);
+        uint32_t cy = (uint32_t)((instance.y[i] - min_y) * scale_y);
+        keys[i] = {hilbert ? hilbert_index(cx, cy) : morton_index(cx, cy), i};
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<double> x(n), y(n);
+    instance.ids.resize(n);
+    for (int k = 0; k < n; k++)
+    {
+        x[k] = instance.x[keys[k].second];
+        y[k] = instance.y[keys[k].second];
+        instance.ids[k] = keys[k].second + 1;
+    }
+    instance.x.swap(x);
+    instance.y.swap(y);
+    instance.curve = curve;
+}
+
+// File id of the 1-based city c.
+static inline int city_label(const std::vector<int> &ids, int c)
+{
+    return ids.empty() ? c : ids[c - 1];
+}
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef LOCAL_SEARCH_HPP
+#define LOCAL_SEARCH_HPP
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "dist_matrix.hpp"
+#include "candidates.hpp"
+#include "population.hpp"
+
+// Local search on a closed tour of n 1-based city ids, in place. Moves only
+// try edges to the candidates of a city, nearest first, and a city whose
+// neighbourhood gave nothing is not looked at again until one of its tour
+// edges changes (its don't-look bit). Each search returns how much the tour
+// length changed, never more than 0.
+
+// Per-thread scratch, grown on demand, so a search allocates nothing once
+// the thread has seen a tour of the same size.
+struct SearchScratch
+{
+    // Where each city sits in the tour.
+    std::vector<int32_t> position;
+    // Cities to look at, as a ring of size = n slots from head, and whether
+    // each one is in it.
+    std::vector<int32_t> queue;
+    std::vector<uint8_t> queued;
+    int size, head, count;
+
+    // Cities are 1..n. Every city starts queued.
+    template <typename Idx>
+    void reset(const Idx *path, int n)
+    {
+        if ((int)position.size() < n + 1)
+        {
+            position.resize(n + 1);
+            queue.resize(n);
+            queued.resize(n + 1);
+        }
+        for (int k = 0; k < n; k++)
+        {
+            position[path[k]] = k;
+            queue[k] = path[k];
+            queued[path[k]] = 1;
+        }
+        size = n;
+        head = 0;
+        count = n;
+    }
+
+    inline void push(int city)
+    {
+        if (queued[city])
+            return;
+        queued[city] = 1;
+        int tail = head + count < size ? head + count : head + count - size;
+        queue[tail] = city;
+        count++;
+    }
+
+    inline int pop()
+    {
+        int city = queue[head];
+        head = head + 1 == size ? 0 : head + 1;
+        count--;
+        queued[city] = 0;
+        return city;
+    }
+};
+
+static inline SearchScratch &search_scratch()
+{
+    static thread_local SearchScratch scratch;
+    return scratch;
+}
+
+// Reverses the tour between positions i and j inclusive, going forwards and
+// wrapping around the end. The other side of the tour is reversed instead
+// when it is shorter: both give the same cycle.
+template <typename Idx>
+static inline void reverse_span(Idx *path, int32_t *position, int n, int i, int j)
+{
+    int len = j - i >= 0 ? j - i + 1 : j - i + n + 1;
+    if (2 * len > n)
+    {
+        int k = i;
+        i = j + 1 == n ? 0 : j + 1;
+        j = k == 0 ? n - 1 : k - 1;
+        len = n - len;
+    }
+    for (int s = 0; s < len / 2; s++)
+    {
+        std::swap(path[i], path[j]);
+        position[path[i]] = i;
+        position[path[j]] = j;
+        i = i + 1 == n ? 0 : i + 1;
+        j = j == 0 ? n - 1 : j - 1;
+    }
+}
+
+// Replaces the tour edges (a, b) and (c, d) by (a, c) and (b, d), where b
+// follows a as d follows c, both forwards or both backwards.
+template <typename Idx>
+static inline void flip_edges(Idx *path, int32_t *position, int n, int a, int b, int c, int d)
+{
+    if ((int)path[position[a] + 1 == n ? 0 : position[a] + 1] == b)
+        reverse_span(path, position, n, position[b], position[c]);
+    else
+        reverse_span(path, position, n, position[a], position[d]);
+}
+
+// two_opt and or_opt make at most moves_per_city * n improving moves, which
+// bounds what one call costs a child in the memetic mode (--search-moves).
+// Every move shortens the tour, so with enough moves they stop by themselves
+// once no city is queued: from a random tour 2-opt takes about 2.5 moves per
+// city (ch150, dsj1000) and Or-opt after it about 0.1. local_optimum_moves
+// is enough for that on any instance but a pathological one.
+static const int local_optimum_moves = 64;
+
+// 2-opt with neighbour lists: for a city a and its tour neighbour b, each
+// candidate c of a closer than b gives the move that swaps the edges (a, b)
+// and (c, e), e being the neighbour of c on the same side, for (a, c) and
+// (b, e). The first improving move is taken and its four cities requeued.
+// Tours without candidate lists are left alone.
+template <typename Dist, typename Idx>
+static length_t two_opt(const Dist &dist, const CandidateLists &candidates, Idx *path, int n, int moves_per_city)
+{
+    if (candidates.size() != n || n < 5)
+        return 0;
+    SearchScratch &s = search_scratch();
+    s.reset(path, n);
+    int32_t *position = s.position.data();
+    auto d = [&](int a, int b)
+    { return (length_t)dist(a - 1, b - 1); };
+    auto succ = [&](int c)
+    { return path[position[c] + 1 == n ? 0 : position[c] + 1]; };
+    auto pred = [&](int c)
+    { return path[position[c] == 0 ? n - 1 : position[c] - 1]; };
+    length_t delta = 0;
+    long moves = (long)moves_per_city * n;
+    while (s.count > 0 && moves > 0)
+    {
+        int a = s.pop();
+        bool improved = false;
+        for (int forward = 1; forward >= 0 && !improved; forward--)
+        {
+            int b = forward ? succ(a) : pred(a);
+            length_t ab = d(a, b);
+            for (const int32_t *m = candidates.begin(a - 1); m != candidates.end(a - 1); m++)
+            {
+                int c = *m + 1;
+                length_t ac = d(a, c);
+                if (ac >= ab)
+                    break;
+                int e = forward ? succ(c) : pred(c);
+                if (c == b || e == a)
+                    continue;
+                length_t change = ac + d(b, e) - ab - d(c, e);
+                if (change >= 0)
+                    continue;
+                flip_edges(path, position, n, a, b, c, e);
+                delta += change;
+                moves--;
+                s.push(a);
+                s.push(b);
+                s.push(c);
+                s.push(e);
+                improved = true;
+                break;
+            }
+        }
+    }
+    return delta;
+}
+
+// Longest segment or_opt moves.
+static const int or_opt_span = 3;
+
+// Or-opt with neighbour lists: a segment of 1 to or_opt_span cities that
+// starts at a city s1, in either direction, is cut out between p and q and
+// put back between a candidate c of s1 and a tour neighbour e of c, with s1
+// next to c. Cutting gains d(p, s1) + d(s2, q) - d(p, q), the gain bounds
+// d(c, s1) as in two_opt, and the move is taken when the insertion costs
+// less than the gain. The move itself is two or three edge flips.
+template <typename Dist, typename Idx>
+static length_t or_opt(const Dist &dist, const CandidateLists &candidates, Idx *path, int n, int moves_per_city)
+{
+    if (candidates.size() != n || n < 8)
+        return 0;
+    SearchScratch &s = search_scratch();
+    s.reset(path, n);
+    int32_t *position = s.position.data();
+    auto d = [&](int a, int b)
+    { return (length_t)dist(a - 1, b - 1); };
+    length_t delta = 0;
+    long moves = (long)moves_per_city * n;
+    while (s.count > 0 && moves > 0)
+    {
+        int s1 = s.pop();
+        bool improved = false;
+        for (int forward = 1; forward >= 0 && !improved; forward--)
+        {
+            // Tour neighbours in the direction the segment is read in.
+            auto next = [&](int c)
+            {
+                int k = forward ? position[c] + 1 : position[c] - 1 + n;
+                return (int)path[k >= n ? k - n : k];
+            };
+            auto prev = [&](int c)
+            {
+                int k = forward ? position[c] - 1 + n : position[c] + 1;
+                return (int)path[k >= n ? k - n : k];
+            };
+            int p = prev(s1);
+            int segment[or_opt_span];
+            int s2 = s1;
+            for (int len = 1; len <= or_opt_span && !improved; len++, s2 = next(s2))
+            {
+                segment[len - 1] = s2;
+                int q = next(s2);
+                auto inside = [&](int c)
+                { return std::find(segment, segment + len, c) != segment + len; };
+                length_t gain = d(p, s1) + d(s2, q) - d(p, q);
+                if (gain <= 0)
+                    continue;
+                for (const int32_t *m = candidates.begin(s1 - 1); m != candidates.end(s1 - 1) && !improved; m++)
+                {
+                    int c = *m + 1;
+                    length_t cs1 = d(c, s1);
+                    if (cs1 >= gain)
+                        break;
+                    if (inside(c))
+                        continue;
+                    for (int e : {next(c), prev(c)})
+                    {
+                        // The segment goes in as x .. y, x before y as read.
+                        int x = e == next(c) ? c : e;
+                        int y = e == next(c) ? e : c;
+                        if (inside(e) || y == p)
+                            continue;
+                        length_t change = cs1 + d(s2, e) - d(c, e) - gain;
+                        if (change >= 0)
+                            continue;
+                        // p s1..s2 q .. x y becomes p q .. x s2..s1 y, and
+                        // the segment is turned back when s1 goes next to x.
+                        flip_edges(path, position, n, p, s1, x, y);
+                        if (x != q)
+                            flip_edges(path, position, n, p, x, q, s2);
+                        if (c == x && s1 != s2)
+                            flip_edges(path, position, n, x, s2, s1, y);
+                        delta += change;
+                        moves--;
+                        for (int t : {p, q, s1, s2, c, e})
+                            s.push(t);
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return delta;
+}
+
+// Most flips in one chain of lin_kernighan.
+static const int lk_depth = 10;
+
+// Lin-Kernighan style variable-depth search, as a chain of flips from t1:
+// the tour edge (t1, t2) is broken, t2 is joined to a candidate t3 with a
+// positive partial gain, and breaking (t3, t4) for the t4 that keeps a tour
+// closes it with (t4, t1). The chain goes on from (t1, t4) up to lk_depth
+// flips, never breaking an edge it added, so two flips make a sequential
+// 3-opt move and longer chains deeper ones. It then rolls back to its
+// shortest tour, and keeps it if that is shorter than the start. t3 is the
+// candidate that leaves the largest gain after breaking (t3, t4).
+// Gives up once seconds have passed, checked between chains.
+template <typename Dist, typename Idx>
+static length_t lin_kernighan(const Dist &dist, const CandidateLists &candidates, Idx *path, int n, double seconds)
+{
+    if (candidates.size() != n || n < 8)
+        return 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    SearchScratch &s = search_scratch();
+    s.reset(path, n);
+    int32_t *position = s.position.data();
+    auto d = [&](int a, int b)
+    { return (length_t)dist(a - 1, b - 1); };
+    auto succ = [&](int c)
+    { return (int)path[position[c] + 1 == n ? 0 : position[c] + 1]; };
+    auto pred = [&](int c)
+    { return (int)path[position[c] == 0 ? n - 1 : position[c] - 1]; };
+    // The flips of the chain as (t2, t3, t4), and the edges it added.
+    int chain[lk_depth][3];
+    int added[lk_depth][2];
+    length_t delta = 0;
+    while (s.count > 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        int t1 = s.pop();
+        for (int forward = 1; forward >= 0; forward--)
+        {
+            int t2 = forward ? succ(t1) : pred(t1);
+            // gain: removed minus added so far, with (t1, t2) still open.
+            length_t gain = d(t1, t2);
+            length_t change = 0, best = 0;
+            int depth = 0, kept = 0;
+            while (depth < lk_depth)
+            {
+                bool after = succ(t1) == t2;
+                int t3 = -1, t4 = -1;
+                length_t left = 0;
+                for (const int32_t *m = candidates.begin(t2 - 1); m != candidates.end(t2 - 1); m++)
+                {
+                    int c = *m + 1;
+                    length_t g1 = gain - d(t2, c);
+                    if (g1 <= 0)
+                        break;
+                    int c4 = after ? pred(c) : succ(c);
+                    if (c == t1 || c4 == t2)
+                        continue;
+                    bool tabu = false;
+                    for (int k = 0; k < depth; k++)
+                        tabu = tabu || (added[k][0] == c && added[k][1] == c4) || (added[k][0] == c4 && added[k][1] == c);
+                    if (tabu)
+                        continue;
+                    if (t3 < 0 || g1 + d(c, c4) > left)
+                    {
+                        t3 = c;
+                        t4 = c4;
+                        left = g1 + d(c, c4);
+                    }
+                }
+                if (t3 < 0)
+                    break;
+                flip_edges(path, position, n, t1, t2, t4, t3);
+                change += d(t2, t3) + d(t4, t1) - d(t1, t2) - d(t3, t4);
+                chain[depth][0] = t2;
+                chain[depth][1] = t3;
+                chain[depth][2] = t4;
+                added[depth][0] = t2;
+                added[depth][1] = t3;
+                depth++;
+                if (change < best)
+                {
+                    best = change;
+                    kept = depth;
+                }
+                gain = left;
+                t2 = t4;
+            }
+            // Undo the flips after the shortest tour, last first.
+            while (depth > kept)
+            {
+                depth--;
+                flip_edges(path, position, n, t1, chain[depth][2], chain[depth][0], chain[depth][1]);
+            }
+            if (kept > 0)
+            {
+                delta += best;
+                s.push(t1);
+                for (int k = 0; k < kept; k++)
+                {
+                    for (int t : chain[k])
+                        s.push(t);
+                }
+                break;
+            }
+        }
+    }
+    return delta;
+}
+
+// Sorts the count best keys of the ranked quarter (keys[0..P/4) after
+// rank_population or rank_elites) to the front, best first, and returns how
+// many elites that leaves.
+static inline int sort_elites(std::vector<RankKey> &keys, int count)
+{
+    int quarter = keys.size() / 4;
+    count = std::min(count, quarter);
+    if (count > 0)
+        std::partial_sort(keys.begin(), keys.begin() + count, keys.begin() + quarter, fitter);
+    return count;
+}
+
+// Runs lin_kernighan for seconds on the elites block, block + blocks, ...
+// below count, as sorted by sort_elites, and updates their lengths in the
+// population and in keys. The selection weights are left alone; the next
+// ranking sees the shorter tours.
+template <typename Idx, typename Dist>
+static void improve_elite_block(std::vector<Chromosome<Idx>> &population, std::vector<RankKey> &keys, int count,
+                                int block, int blocks, const Dist &dist, const CandidateLists &candidates, int n,
+                                double seconds)
+{
+    for (int e = block; e < count; e += blocks)
+    {
+        Chromosome<Idx> *c = &population[keys[e].slot];
+        c->length += lin_kernighan(dist, candidates, c->path, n, seconds);
+        keys[e].length = c->length;
+    }
+}
+
+// Improves the count best tours with lin_kernighan, one block of elites per
+// worker; for_blocks(blocks, f) calls f(b) for every block as in
+// normalize_selection.
+template <typename Idx, typename Dist, typename ForBlocks>
+static void improve_elites(std::vector<Chromosome<Idx>> &population, std::vector<RankKey> &keys, int count,
+                           const Dist &dist, const CandidateLists &candidates, int n, double seconds, int nw,
+                           ForBlocks for_blocks)
+{
+    int elites = sort_elites(keys, count);
+    if (elites == 0)
+        return;
+    int blocks = std::min(elites, std::max(1, nw));
+    for_blocks(blocks, [&](int b)
+               { improve_elite_block(population, keys, elites, b, blocks, dist, candidates, n, seconds); });
+}
+
+#endif
\ No newline at end of file
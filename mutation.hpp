@@ -0,0 +1,139 @@
+#ifndef MUTATION_HPP
+#define MUTATION_HPP
+
+#include <utility>
+#include <random>
+#include <algorithm>
+#include "dist_matrix.hpp"
+#include "breeding_rng.hpp"
+
+// Mutation operators on a closed tour of n 1-based city ids. Each one edits
+// the tour in place and returns how much its length changed, from the few
+// edges it touched, so a mutated chromosome never needs a full re-evaluation.
+
+// Swaps the cities at positions i and j; at most four edges change.
+template <typename Dist, typename Idx>
+static inline length_t swap_mutation(const Dist &dist, Idx *path, int n, int i, int j)
+{
+    if (i == j)
+        return 0;
+    if (i > j)
+        std::swap(i, j);
+    int pi = i == 0 ? n - 1 : i - 1;
+    int ni = i + 1;
+    int pj = j - 1;
+    int nj = j == n - 1 ? 0 : j + 1;
+    auto edges = [&]()
+    {
+        auto d = [&](int a, int b)
+        { return (length_t)dist(path[a] - 1, path[b] - 1); };
+        // The edge between i and j, when they are neighbours, does not change.
+        if (ni == j)
+            return d(pi, i) + d(j, nj);
+        if (nj == i)
+            return d(pj, j) + d(i, ni);
+        return d(pi, i) + d(i, ni) + d(pj, j) + d(j, nj);
+    };
+    length_t before = edges();
+    std::swap(path[i], path[j]);
+    return edges() - before;
+}
+
+// Reverses path[i..j] (a 2-opt move); two edges change. Reversing the whole
+// tour changes none.
+template <typename Dist, typename Idx>
+static inline length_t inversion_mutation(const Dist &dist, Idx *path, int n, int i, int j)
+{
+    if (i > j)
+        std::swap(i, j);
+    if (i == j || (i == 0 && j == n - 1))
+    {
+        std::reverse(path + i, path + j + 1);
+        return 0;
+    }
+    auto d = [&](int a, int b)
+    { return (length_t)dist(path[a] - 1, path[b] - 1); };
+    int pi = i == 0 ? n - 1 : i - 1;
+    int nj = j == n - 1 ? 0 : j + 1;
+    length_t delta = d(pi, j) + d(i, nj) - d(pi, i) - d(j, nj);
+    std::reverse(path + i, path + j + 1);
+    return delta;
+}
+
+// Moves the city at position i to between the cities at j and j + 1; three
+// edges change, and the cities in between shift by one.
+template <typename Dist, typename Idx>
+static inline length_t insertion_mutation(const Dist &dist, Idx *path, int n, int i, int j)
+{
+    int pi = i == 0 ? n - 1 : i - 1;
+    int ni = i == n - 1 ? 0 : i + 1;
+    int nj = j == n - 1 ? 0 : j + 1;
+    if (j == i || j == pi)
+        return 0;
+    auto d = [&](int a, int b)
+    { return (length_t)dist(path[a] - 1, path[b] - 1); };
+    length_t delta = d(pi, ni) - d(pi, i) - d(i, ni) + d(j, i) + d(i, nj) - d(j, nj);
+    if (j > i)
+        std::rotate(path + i, path + i + 1, path + j + 1);
+    else
+        std::rotate(path + j + 1, path + i, path + i + 1);
+    return delta;
+}
+
+// Longest segment scramble_mutation shuffles.
+static const int scramble_span = 16;
+
+// Shuffles path[i..i + span); the change is summed over the span + 1 edges
+// around and inside it.
+template <typename Dist, typename Idx, typename Rng>
+static inline length_t scramble_mutation(const Dist &dist, Idx *path, int n, int i, int span, Rng &rng)
+{
+    span = std::min(span, n - 2);
+    if (span < 2)
+        return 0;
+    i = std::min(i, n - span);
+    auto edges = [&]()
+    {
+        length_t total = 0;
+        for (int k = i - 1; k < i + span; k++)
+            total += dist(path[(k + n) % n] - 1, path[(k + 1) % n] - 1);
+        return total;
+    };
+    length_t before = edges();
+    std::shuffle(path + i, path + i + span, rng);
+    return edges() - before;
+}
+
+// Chance per child of each mutation; each one is drawn independently.
+struct MutationRates
+{
+    double swap;
+    double inversion;
+    double insertion;
+    double scramble;
+};
+
+// Applies each mutation to the tour with its rate and returns the total
+// change in length.
+template <typename Dist, typename Idx>
+static length_t mutate_tour(const Dist &dist, Idx *path, int n, const MutationRates &rates)
+{
+    std::mt19937 &rng = breeding_rng();
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::uniform_int_distribution<int> position(0, n - 1);
+    length_t delta = 0;
+    if (chance(rng) < rates.swap)
+        delta += swap_mutation(dist, path, n, position(rng), position(rng));
+    if (chance(rng) < rates.inversion)
+        delta += inversion_mutation(dist, path, n, position(rng), position(rng));
+    if (chance(rng) < rates.insertion)
+        delta += insertion_mutation(dist, path, n, position(rng), position(rng));
+    if (chance(rng) < rates.scramble)
+    {
+        std::uniform_int_distribution<int> span(2, scramble_span);
+        delta += scramble_mutation(dist, path, n, position(rng), span(rng), rng);
+    }
+    return delta;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef POPULATION_HPP
+#define POPULATION_HPP
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "dist_matrix.hpp"
+
+// A chromosome is a view of one tour in the population arena plus its exact
+// length, which every operator keeps up to date. Tours hold 1-based city ids
+// as Idx, the narrowest unsigned type that fits every id (see with_index).
+template <typename Idx>
+struct Chromosome
+{
+    Idx *path;
+    length_t length;
+};
+
+// Every tour of the population, and the spare tours children are bred into,
+// in one aligned block. Each slot is padded to whole cache lines, so threads
+// writing neighbouring slots never share a line.
+template <typename Idx>
+class PopulationArena
+{
+public:
+    PopulationArena()
+    {
+    }
+
+    PopulationArena(const PopulationArena &) = delete;
+    PopulationArena &operator=(const PopulationArena &) = delete;
+
+    ~PopulationArena()
+    {
+        free(block);
+    }
+
+    void reset(int slots, int n)
+    {
+        free(block);
+        size_t per_line = cache_line_bytes / sizeof(Idx);
+        stride = (n + per_line - 1) / per_line * per_line;
+        count = (size_t)slots * stride;
+        block = (Idx *)aligned_block(count * sizeof(Idx));
+    }
+
+    inline Idx *slot(int s) const
+    {
+        return block + (size_t)s * stride;
+    }
+
+    size_t bytes() const
+    {
+        return count * sizeof(Idx);
+    }
+
+private:
+    Idx *block = NULL;
+    size_t stride = 0;
+    size_t count = 0;
+};
+
+// Points population at the first population_size slots of a fresh arena and
+// children at the population_size / 2 slots after them.
+template <typename Idx>
+static void arena_population(PopulationArena<Idx> &arena, std::vector<Chromosome<Idx>> &population,
+                             std::vector<Chromosome<Idx>> &children, int population_size, int n)
+{
+    int half = population_size / 2;
+    arena.reset(population_size + half, n);
+    population.resize(population_size);
+    children.resize(half);
+    for (int i = 0; i < population_size; i++)
+        population[i] = {arena.slot(i), 0};
+    for (int i = 0; i < half; i++)
+        children[i] = {arena.slot(population_size + i), 0};
+}
+
+// What the population is ranked by: the tours stay in their slots and only
+// these pairs are reordered.
+struct RankKey
+{
+    length_t length;
+    int slot;
+};
+
+static inline bool fitter(const RankKey &a, const RankKey &b)
+{
+    return a.length < b.length;
+}
+
+// Selection state per slot, kept apart from the tours and their lengths:
+// fitness = 1 / length, probability = fitness / sum of fitness, and
+// cumulative[i] = probability[0] + ... + probability[i] for roulette draws.
+struct SelectionWeights
+{
+    std::vector<float> fitness;
+    std::vector<float> probability;
+    std::vector<float> cumulative;
+};
+
+// Ranks the population by length in O(P): afterwards keys[0..P/4) hold the
+// best quarter and keys[0..P/2) the best half, each in no particular order.
+// The same pass fills selection.fitness and returns its sum.
+template <typename Idx>
+static float rank_population(const std::vector<Chromosome<Idx>> &population, SelectionWeights &selection,
+                             std::vector<RankKey> &keys)
+{
+    int size = population.size();
+    keys.resize(size);
+    selection.fitness.resize(size);
+    float sum = 0;
+    for (int i = 0; i < size; i++)
+    {
+        keys[i] = {population[i].length, i};
+        selection.fitness[i] = 1.0f / population[i].length;
+        sum += selection.fitness[i];
+    }
+    std::nth_element(keys.begin(), keys.begin() + size / 2, keys.end(), fitter);
+    std::nth_element(keys.begin(), keys.begin() + size / 4, keys.begin() + size / 2, fitter);
+    return sum;
+}
+
+static const int prefix_parallel_min = 1 << 15;
+
+// Runs f(b) for b in [0, count) on the calling thread.
+struct SerialBlocks
+{
+    template <typename F>
+    void operator()(int count, F f) const
+    {
+        for (int b = 0; b < count; b++)
+            f(b);
+    }
+};
+
+// Fills selection.probability and selection.cumulative from the fitness and
+// its sum with a blocked prefix sum: each block is normalized and summed, a
+// serial pass turns the block sums into offsets, and each block then writes
+// its running sums. for_blocks(count, f) must call f(b) for every block b,
+// possibly in parallel; populations below prefix_parallel_min use one block.
+template <typename ForBlocks>
+static void normalize_selection(SelectionWeights &selection, float sum, int nw, ForBlocks for_blocks)
+{
+    int size = selection.fitness.size();
+    selection.probability.resize(size);
+    selection.cumulative.resize(size);
+    int blocks = size >= prefix_parallel_min ? std::max(1, nw) : 1;
+    std::vector<float> offset(blocks + 1, 0);
+    float scale = 1.0f / sum;
+    for_blocks(blocks, [&](int b)
+               {
+                   float total = 0;
+                   for (long i = (long)size * b / blocks; i < (long)size * (b + 1) / blocks; i++)
+                   {
+                       selection.probability[i] = selection.fitness[i] * scale;
+                       total += selection.probability[i];
+                   }
+                   offset[b + 1] = total;
+               });
+    for (int b = 0; b < blocks; b++)
+        offset[b + 1] += offset[b];
+    for_blocks(blocks, [&](int b)
+               {
+                   float running = offset[b];
+                   for (long i = (long)size * b / blocks; i < (long)size * (b + 1) / blocks; i++)
+                   {
+                       running += selection.probability[i];
+                       selection.cumulative[i] = running;
+                   }
+               });
+}
+
+// Sorts the best count keys to the front, best first.
+static inline void rank_best(std::vector<RankKey> &keys, int count)
+{
+    count = std::min<int>(count, keys.size());
+    std::partial_sort(keys.begin(), keys.begin() + count, keys.end(), fitter);
+}
+
+// Replaces the worse half of the population with the children by swapping
+// views; the tours they displace are what the next children are bred into.
+template <typename Idx>
+static inline void replace_with_children(std::vector<Chromosome<Idx>> &population, const std::vector<RankKey> &keys,
+                                         std::vector<Chromosome<Idx>> &children)
+{
+    size_t half = population.size() / 2;
+    for (size_t i = 0; i < children.size(); i++)
+        std::swap(population[keys[half + i].slot], children[i]);
+}
+
+// Calls run(Idx()) with the narrowest city index that holds the ids 1..n:
+// uint8_t up to 255 cities, uint16_t up to 65535, uint32_t beyond.
+template <typename Run>
+static void with_index(int n, Run run)
+{
+    if (n <= UINT8_MAX)
+        run(uint8_t());
+    else if (n <= UINT16_MAX)
+        run(uint16_t());
+    else
+        run(uint32_t());
+}
+
+#endif
@@ -0,0 +1,355 @@
+#ifndef SELECTION_HPP
+#define SELECTION_HPP
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "ga_options.hpp"
+#include "population.hpp"
+#include "breeding_rng.hpp"
+
+// Roulette-wheel draws over the selection weights of a generation. Both
+// wheels are built once after ranking and then only read, so every worker
+// can draw from them without locking.
+
+// Slot whose cumulative weight is the first above r, by binary search:
+// O(log P) per draw instead of the O(P) running sum.
+static inline int roulette_slot(const std::vector<float> &cumulative, double r)
+{
+    int slot = std::upper_bound(cumulative.begin(), cumulative.end(), r) - cumulative.begin();
+    // Rounding can leave the last weight just under 1.
+    return std::min<int>(slot, cumulative.size() - 1);
+}
+
+// Walker's alias method (Vose's construction): O(P) to build, O(1) per draw.
+// Column i is picked uniformly and kept with probability keep[i], otherwise
+// it hands the draw to alias[i].
+class AliasTable
+{
+public:
+    void build(const std::vector<float> &probability)
+    {
+        int n = probability.size();
+        keep.resize(n);
+        alias.resize(n);
+        small.clear();
+        large.clear();
+        for (int i = 0; i < n; i++)
+        {
+            keep[i] = probability[i] * n;
+            alias[i] = i;
+            if (keep[i] < 1)
+                small.push_back(i);
+            else
+                large.push_back(i);
+        }
+        while (!small.empty() && !large.empty())
+        {
+            int s = small.back();
+            int l = large.back();
+            small.pop_back();
+            alias[s] = l;
+            keep[l] -= 1 - keep[s];
+            if (keep[l] < 1)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // What is left is 1 up to rounding.
+        for (int i : large)
+            keep[i] = 1;
+        for (int i : small)
+            keep[i] = 1;
+    }
+
+    // u uniform in [0, 1]: its integer part scaled by n picks the column and
+    // the fraction decides between the column and its alias.
+    inline int pick(double u) const
+    {
+        int n = keep.size();
+        double scaled = u * n;
+        int i = std::min((int)scaled, n - 1);
+        return scaled - i < keep[i] ? i : alias[i];
+    }
+
+    int size() const
+    {
+        return keep.size();
+    }
+
+private:
+    std::vector<double> keep;
+    std::vector<int> alias;
+    std::vector<int> small;
+    std::vector<int> large;
+};
+
+// Mate for the parent in slot parent from the draw r: on the alias table when
+// there is one, else on the cumulative weights. A draw that lands on the
+// parent moves to the next slot, as the linear scan used to.
+static inline int roulette_mate(const std::vector<float> &cumulative, const AliasTable *alias, double r, int parent)
+{
+    int slot = alias != NULL ? alias->pick(r) : roulette_slot(cumulative, r);
+    return slot == parent ? (slot + 1) % (int)cumulative.size() : slot;
+}
+
+static inline double unit_draw()
+{
+    return (double)breeding_rng()() / std::mt19937::max();
+}
+
+// Selection policies. Each generation the driver ranks the population and
+// calls prepare(keys, weights); breeding then asks parent(population, i) for
+// the first parent of child i and mate(population, i, parent) for the second.
+// Policies with ranked = true need rank_population and normalize_selection
+// first, and breed the best half (keys[0..P/2)) in turn. The others only need
+// rank_elites, which keeps the best quarter without ranking the rest.
+// prepare runs on one thread; parent and mate only read.
+
+// Fitness-proportionate draws, on the cumulative weights or an alias table.
+class RouletteSelection
+{
+public:
+    static const bool ranked = true;
+
+    RouletteSelection(const GaOptions &options) : alias(strcmp(options.wheel, "alias") == 0)
+    {
+    }
+
+    void prepare(const std::vector<RankKey> &keys, const SelectionWeights &weights)
+    {
+        this->keys = &keys;
+        cumulative = &weights.cumulative;
+        if (alias)
+            wheel.build(weights.probability);
+    }
+
+    template <typename Idx>
+    inline int parent(const std::vector<Chromosome<Idx>> &, int i) const
+    {
+        return (*keys)[i].slot;
+    }
+
+    template <typename Idx>
+    inline int mate(const std::vector<Chromosome<Idx>> &, int, int parent) const
+    {
+        return roulette_mate(*cumulative, alias ? &wheel : NULL, unit_draw(), parent);
+    }
+
+private:
+    bool alias;
+    AliasTable wheel;
+    const std::vector<RankKey> *keys = NULL;
+    const std::vector<float> *cumulative = NULL;
+};
+
+// Stochastic universal sampling: the P / 2 mates of a generation sit at
+// evenly spaced points of the cumulative weights from one random offset, so
+// each slot is drawn within one of its expected count.
+class UniversalSelection
+{
+public:
+    static const bool ranked = true;
+
+    UniversalSelection(const GaOptions &)
+    {
+    }
+
+    void prepare(const std::vector<RankKey> &keys, const SelectionWeights &weights)
+    {
+        this->keys = &keys;
+        cumulative = &weights.cumulative;
+        draws = std::max<int>(1, keys.size() / 2);
+        offset = unit_draw();
+    }
+
+    template <typename Idx>
+    inline int parent(const std::vector<Chromosome<Idx>> &, int i) const
+    {
+        return (*keys)[i].slot;
+    }
+
+    template <typename Idx>
+    inline int mate(const std::vector<Chromosome<Idx>> &, int i, int parent) const
+    {
+        return roulette_mate(*cumulative, NULL, (offset + i) / draws, parent);
+    }
+
+private:
+    const std::vector<RankKey> *keys = NULL;
+    const std::vector<float> *cumulative = NULL;
+    int draws = 1;
+    double offset = 0;
+};
+
+// Selective pressure of linear ranking: the best tour is rank_pressure times
+// as likely as the median one and the worst 2 - rank_pressure times.
+static const double rank_pressure = 1.5;
+
+// Linear ranking: the chance of a tour depends on its rank only, so a few
+// very short tours cannot take over the wheel. Draws invert the cumulative
+// rank weights in closed form.
+class RankSelection
+{
+public:
+    static const bool ranked = true;
+
+    RankSelection(const GaOptions &)
+    {
+    }
+
+    // Linear ranking needs the rank of every tour, while the ranking only
+    // places the quarter and half boundaries, so this is the one policy that
+    // pays for a full O(P log P) sort. It sorts a copy of the (length, slot)
+    // keys, not the tours: about 6 ms at P = 100k and 80 ms at 1M.
+    void prepare(const std::vector<RankKey> &keys, const SelectionWeights &)
+    {
+        this->keys = &keys;
+        order = keys;
+        std::sort(order.begin(), order.end(), fitter);
+    }
+
+    template <typename Idx>
+    inline int parent(const std::vector<Chromosome<Idx>> &, int i) const
+    {
+        return (*keys)[i].slot;
+    }
+
+    // Rank x of a draw u solves u = (s x - (s - 1) x^2 / (P - 1)) / P.
+    template <typename Idx>
+    inline int mate(const std::vector<Chromosome<Idx>> &, int, int parent) const
+    {
+        int size = order.size();
+        double u = unit_draw();
+        double a = (rank_pressure - 1) / std::max(1, size - 1);
+        double root = sqrt(std::max(0.0, rank_pressure * rank_pressure - 4 * a * u * size));
+        int rank = std::min(size - 1, (int)((rank_pressure - root) / (2 * a)));
+        if (order[rank].slot == parent)
+            rank = (rank + 1) % size;
+        return order[rank].slot;
+    }
+
+private:
+    const std::vector<RankKey> *keys = NULL;
+    std::vector<RankKey> order;
+};
+
+// k-tournament: both parents are the shortest of k slots drawn uniformly.
+// Needs no weights and no ranking beyond the elites.
+class TournamentSelection
+{
+public:
+    static const bool ranked = false;
+
+    TournamentSelection(const GaOptions &options) : k(options.tournament)
+    {
+    }
+
+    void prepare(const std::vector<RankKey> &, const SelectionWeights &)
+    {
+    }
+
+    template <typename Idx>
+    inline int parent(const std::vector<Chromosome<Idx>> &population, int) const
+    {
+        return winner(population, -1);
+    }
+
+    template <typename Idx>
+    inline int mate(const std::vector<Chromosome<Idx>> &population, int, int parent) const
+    {
+        return winner(population, parent);
+    }
+
+private:
+    template <typename Idx>
+    inline int winner(const std::vector<Chromosome<Idx>> &population, int parent) const
+    {
+        int size = population.size();
+        int best = -1;
+        for (int t = 0; t < k; t++)
+        {
+            int s = random_below(size);
+            if (s == parent)
+                s = (s + 1) % size;
+            if (best < 0 || population[s].length < population[best].length)
+                best = s;
+        }
+        return best;
+    }
+
+    int k;
+};
+
+// For the unranked policies: keys[0..P/4) become the best quarter, by a
+// parallel top-k (each block keeps its own best quarter, then the block
+// winners are merged), and keys[P/4..P) the other slots in slot order from
+// start, so the half that children replace moves around the population.
+// for_blocks is as for normalize_selection.
+template <typename Idx, typename ForBlocks>
+static void rank_elites(const std::vector<Chromosome<Idx>> &population, std::vector<RankKey> &keys, int start, int nw,
+                        ForBlocks for_blocks)
+{
+    int size = population.size();
+    int elites = size / 4;
+    int blocks = size >= prefix_parallel_min ? std::max(1, nw) : 1;
+    std::vector<std::vector<RankKey>> best(blocks);
+    for_blocks(blocks, [&](int b)
+               {
+                   std::vector<RankKey> &top = best[b];
+                   for (long s = (long)size * b / blocks; s < (long)size * (b + 1) / blocks; s++)
+                       top.push_back({population[s].length, (int)s});
+                   int m = std::min<int>(elites, top.size());
+                   std::nth_element(top.begin(), top.begin() + m, top.end(), fitter);
+                   top.resize(m);
+               });
+    std::vector<RankKey> merged;
+    for (auto &top : best)
+        merged.insert(merged.end(), top.begin(), top.end());
+    std::nth_element(merged.begin(), merged.begin() + elites, merged.end(), fitter);
+    keys.resize(size);
+    std::vector<char> elite(size, 0);
+    for (int e = 0; e < elites; e++)
+    {
+        keys[e] = merged[e];
+        elite[merged[e].slot] = 1;
+    }
+    int next = elites;
+    for (int t = 0; t < size; t++)
+    {
+        int s = (start + t) % size;
+        if (!elite[s])
+            keys[next++] = {population[s].length, s};
+    }
+}
+
+// Calls run(policy) with the policy named by --selection.
+template <typename Run>
+static void with_selection(const GaOptions &options, Run run)
+{
+    if (strcmp(options.selection, "tournament") == 0)
+    {
+        TournamentSelection policy(options);
+        run(policy);
+    }
+    else if (strcmp(options.selection, "sus") == 0)
+    {
+        UniversalSelection policy(options);
+        run(policy);
+    }
+    else if (strcmp(options.selection, "rank") == 0)
+    {
+        RankSelection policy(options);
+        run(policy);
+    }
+    else
+    {
+        RouletteSelection policy(options);
+        run(policy);
+    }
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef TOUR_KERNELS_HPP
+#define TOUR_KERNELS_HPP
+
+#include <stdint.h>
+#include "dist_matrix.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOUR_KERNELS_X86
+#endif
+
+// Tour length over a DistanceMatrix with the edge lengths fetched by SIMD
+// gathers: 8 edges per step with AVX2, 16 with AVX-512F. Each kernel is
+// compiled for its own target, and tour_kernel<T, L, Idx> points at the
+// best one the CPU supports, so the binary does not need -mavx2.
+// Gathers read 32 bits per entry, so for uint16_t tables they also read the
+// next entry; that one always exists, as the diagonal (never an edge of a
+// tour) is stored last in both layouts.
+
+template <typename T, typename Idx>
+using TourKernel = length_t (*)(const T *table, int stride, int n, const Idx *path);
+
+template <MatrixLayout L>
+static inline size_t edge_index(size_t a, size_t b, int stride, int n)
+{
+    if (L == MatrixLayout::Full)
+        return a * stride + b;
+    size_t lo = a < b ? a : b;
+    size_t hi = a < b ? b : a;
+    return lo * n - lo * (lo - 1) / 2 + (hi - lo);
+}
+
+template <typename T, MatrixLayout L, typename Idx>
+static length_t tour_scalar(const T *table, int stride, int n, const Idx *path)
+{
+    length_t total = 0;
+    for (int i = 0; i < n - 1; i++)
+    {
+        if (i + 8 < n - 1)
+            __builtin_prefetch(&table[edge_index<L>(path[i + 8] - 1, path[i + 9] - 1, stride, n)]);
+        total += table[edge_index<L>(path[i] - 1, path[i + 1] - 1, stride, n)];
+    }
+    return total + table[edge_index<L>(path[n - 1] - 1, path[0] - 1, stride, n)];
+}
+
+#ifdef TOUR_KERNELS_X86
+template <typename Idx>
+__attribute__((target("avx2"))) static inline __m256i load_ids8(const Idx *p)
+{
+    if constexpr (sizeof(Idx) == 1)
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+    else if constexpr (sizeof(Idx) == 2)
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+    else
+        return _mm256_loadu_si256((const __m256i *)p);
+}
+
+// Table offsets of the edges (path[k], path[k + 1]) for k in [0, 8).
+template <MatrixLayout L, typename Idx>
+__attribute__((target("avx2"))) static inline __m256i edge_offsets8(const Idx *path, __m256i vstride, __m256i vn)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i a = _mm256_sub_epi32(load_ids8(path), one);
+    __m256i b = _mm256_sub_epi32(load_ids8(path + 1), one);
+    if constexpr (L == MatrixLayout::Full)
+        return _mm256_add_epi32(_mm256_mullo_epi32(a, vstride), b);
+    __m256i lo = _mm256_min_epu32(a, b);
+    __m256i hi = _mm256_max_epu32(a, b);
+    __m256i tri = _mm256_srli_epi32(_mm256_mullo_epi32(lo, _mm256_sub_epi32(lo, one)), 1);
+    return _mm256_add_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(lo, vn), tri), _mm256_sub_epi32(hi, lo));
+}
+
+template <typename T, MatrixLayout L, typename Idx>
+__attribute__((target("avx2"))) static length_t tour_avx2(const T *table, int stride, int n, const Idx *path)
+{
+    const __m256i vstride = _mm256_set1_epi32(stride);
+    const __m256i vn = _mm256_set1_epi32(n);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 < n; i += 8)
+    {
+        __m256i off = edge_offsets8<L>(path + i, vstride, vn);
+        __m256i d;
+        if constexpr (sizeof(T) == 4)
+            d = _mm256_i32gather_epi32((const int *)table, off, 4);
+        else
+            d = _mm256_and_si256(_mm256_i32gather_epi32((const int *)table, off, 2), _mm256_set1_epi32(0xffff));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(d)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(d, 1)));
+    }
+    alignas(32) long long lanes[4];
+    _mm256_store_si256((__m256i *)lanes, acc);
+    length_t total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n - 1; i++)
+        total += table[edge_index<L>(path[i] - 1, path[i + 1] - 1, stride, n)];
+    return total + table[edge_index<L>(path[n - 1] - 1, path[0] - 1, stride, n)];
+}
+
+// The AVX-512 code uses the zero-masking forms with every lane set. GCC's
+// unmasked forms merge into _mm512_undefined_*(), which -Wall reports as
+// possibly uninitialized in every file that instantiates these kernels.
+static const __mmask16 lanes16 = 0xffff;
+static const __mmask8 lanes8 = 0xff;
+
+template <typename Idx>
+__attribute__((target("avx512f"))) static inline __m512i load_ids16(const Idx *p)
+{
+    if constexpr (sizeof(Idx) == 1)
+        return _mm512_maskz_cvtepu8_epi32(lanes16, _mm_loadu_si128((const __m128i *)p));
+    else if constexpr (sizeof(Idx) == 2)
+        return _mm512_maskz_cvtepu16_epi32(lanes16, _mm256_loadu_si256((const __m256i *)p));
+    else
+        return _mm512_loadu_si512((const void *)p);
+}
+
+template <MatrixLayout L, typename Idx>
+__attribute__((target("avx512f"))) static inline __m512i edge_offsets16(const Idx *path, __m512i vstride, __m512i vn)
+{
+    const __m512i one = _mm512_set1_epi32(1);
+    __m512i a = _mm512_sub_epi32(load_ids16(path), one);
+    __m512i b = _mm512_sub_epi32(load_ids16(path + 1), one);
+    if constexpr (L == MatrixLayout::Full)
+        return _mm512_add_epi32(_mm512_mullo_epi32(a, vstride), b);
+    __m512i lo = _mm512_maskz_min_epu32(lanes16, a, b);
+    __m512i hi = _mm512_maskz_max_epu32(lanes16, a, b);
+    __m512i tri = _mm512_maskz_srli_epi32(lanes16, _mm512_mullo_epi32(lo, _mm512_sub_epi32(lo, one)), 1);
+    return _mm512_add_epi32(_mm512_sub_epi32(_mm512_mullo_epi32(lo, vn), tri), _mm512_sub_epi32(hi, lo));
+}
+
+template <typename T, MatrixLayout L, typename Idx>
+__attribute__((target("avx512f"))) static length_t tour_avx512(const T *table, int stride, int n, const Idx *path)
+{
+    const __m512i vstride = _mm512_set1_epi32(stride);
+    const __m512i vn = _mm512_set1_epi32(n);
+    __m512i acc = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 16 < n; i += 16)
+    {
+        __m512i off = edge_offsets16<L>(path + i, vstride, vn);
+        __m512i d;
+        if constexpr (sizeof(T) == 4)
+            d = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes16, off, (const void *)table, 4);
+        else
+            d = _mm512_and_si512(_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes16, off, (const void *)table, 2),
+                                 _mm512_set1_epi32(0xffff));
+        acc = _mm512_add_epi64(acc, _mm512_maskz_cvtepi32_epi64(lanes8, _mm512_maskz_extracti64x4_epi64(lanes8, d, 0)));
+        acc = _mm512_add_epi64(acc, _mm512_maskz_cvtepi32_epi64(lanes8, _mm512_maskz_extracti64x4_epi64(lanes8, d, 1)));
+    }
+    alignas(64) long long lanes[8];
+    _mm512_store_si512((void *)lanes, acc);
+    length_t total = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    for (; i < n - 1; i++)
+        total += table[edge_index<L>(path[i] - 1, path[i + 1] - 1, stride, n)];
+    return total + table[edge_index<L>(path[n - 1] - 1, path[0] - 1, stride, n)];
+}
+#endif
+
+// Best kernel for this CPU, from CPUID.
+template <typename T, MatrixLayout L, typename Idx>
+static TourKernel<T, Idx> select_tour_kernel()
+{
+#ifdef TOUR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return tour_avx512<T, L, Idx>;
+    if (__builtin_cpu_supports("avx2"))
+        return tour_avx2<T, L, Idx>;
+#endif
+    return tour_scalar<T, L, Idx>;
+}
+
+template <typename T, MatrixLayout L, typename Idx>
+static const TourKernel<T, Idx> tour_kernel = select_tour_kernel<T, L, Idx>();
+
+static inline const char *tour_kernel_name()
+{
+#ifdef TOUR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512";
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+#endif
+    return "scalar";
+}
+
+// Gathers take 32-bit offsets, so tables with more entries than that stay
+// on the scalar loop.
+template <typename T, MatrixLayout L, typename Idx>
+static inline length_t tour_length(const DistanceMatrix<T, L> &dist, const Idx *path, int n)
+{
+    if (dist.bytes() / sizeof(T) > INT32_MAX)
+        return tour_scalar<T, L, Idx>(dist.table(), dist.row_stride(), n, path);
+    return tour_kernel<T, L, Idx>(dist.table(), dist.row_stride(), n, path);
+}
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef TSP_CACHE_HPP
+#define TSP_CACHE_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <chrono>
+#include "tsp_loader.hpp"
+#include "dist_matrix.hpp"
+#include "ga_options.hpp"
+#include "hilbert.hpp"
+#include "candidates.hpp"
+
+// .tspbin layout: a TspBinHeader followed by page-aligned sections. The header
+// records the .tsp file it was built from (size and mtime) and a checksum of
+// itself, of the O(N) sections in full and of the O(N^2) ones (the distance
+// table and EXPLICIT weights) at evenly spaced samples, so a stale or damaged
+// cache is not used and mapping one does not read a whole table before
+// solving starts.
+enum TspBinSection
+{
+    SectionX,
+    SectionY,
+    SectionWeights,
+    SectionMatrix,
+    SectionNeighbors,
+    SectionIds,
+    SectionCount = 8
+};
+
+struct TspBinHeader
+{
+    char magic[8];
+    uint64_t source_size;
+    int64_t source_mtime;
+    char name[64];
+    char edge_weight_type[32];
+    char curve[16];
+    int32_t weight_type;
+    int32_t weight_format;
+    int32_t dimension;
+    int32_t matrix_layout;
+    int32_t matrix_entry;
+    int32_t neighbors;
+    uint64_t offset[SectionCount];
+    uint64_t bytes[SectionCount];
+    uint64_t checksum;
+};
+
+static const char tspbin_magic[8] = {'T', 'S', 'P', 'B', 'I', 'N', '0', '3'};
+static const size_t tspbin_align = 4096;
+
+static uint64_t tspbin_checksum(uint64_t h, const void *data, size_t bytes)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t words = bytes / 8;
+    for (size_t k = 0; k < words; k++)
+    {
+        uint64_t w;
+        memcpy(&w, p + k * 8, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (size_t k = words * 8; k < bytes; k++)
+        h = (h ^ p[k]) * 0x100000001b3ULL;
+    return h;
+}
+
+// The O(N^2) sections are checksummed as tspbin_samples runs of
+// tspbin_sample_bytes spread evenly over them: a few hundred pages whatever
+// their size.
+static const size_t tspbin_samples = 256;
+static const size_t tspbin_sample_bytes = 256;
+
+static uint64_t tspbin_sampled_checksum(uint64_t h, const void *data, size_t bytes)
+{
+    if (bytes <= tspbin_samples * tspbin_sample_bytes)
+        return tspbin_checksum(h, data, bytes);
+    const char *p = (const char *)data;
+    for (size_t s = 0; s < tspbin_samples; s++)
+        h = tspbin_checksum(h, p + (bytes - tspbin_sample_bytes) * s / (tspbin_samples - 1), tspbin_sample_bytes);
+    return h;
+}
+
+// Checksum of a section as the header records it.
+static inline uint64_t tspbin_section_checksum(uint64_t h, int s, const void *data, size_t bytes)
+{
+    if (s == SectionMatrix || s == SectionWeights)
+        return tspbin_sampled_checksum(h, data, bytes);
+    return tspbin_checksum(h, data, bytes);
+}
+
+static bool tspbin_source(const char *source_path, uint64_t *size, int64_t *mtime)
+{
+    struct stat st;
+    if (stat(source_path, &st) < 0)
+        return false;
+    *size = st.st_size;
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// A read-only shared mapping of a .tspbin file; processes running the same
+// instance share its pages through the page cache.
+class TspCache
+{
+public:
+    TspCache()
+    {
+    }
+
+    TspCache(const TspCache &) = delete;
+    TspCache &operator=(const TspCache &) = delete;
+
+    ~TspCache()
+    {
+        release();
+    }
+
+    // Maps path and validates it; with source_path, also checks that the .tsp
+    // has not changed since the cache was written.
+    bool map_file(const char *path, const char *source_path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TspBinHeader))
+        {
+            close(fd);
+            return false;
+        }
+        size = st.st_size;
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            map = NULL;
+            return false;
+        }
+        header = (const TspBinHeader *)map;
+        if (memcmp(header->magic, tspbin_magic, sizeof(tspbin_magic)) != 0)
+            return release();
+        if (source_path != NULL)
+        {
+            uint64_t source_size;
+            int64_t source_mtime;
+            if (!tspbin_source(source_path, &source_size, &source_mtime) || source_size != header->source_size ||
+                source_mtime != header->source_mtime)
+                return release();
+        }
+        TspBinHeader h = *header;
+        h.checksum = 0;
+        uint64_t checksum = tspbin_checksum(0xcbf29ce484222325ULL, &h, sizeof(h));
+        for (int s = 0; s < SectionCount; s++)
+        {
+            if (header->offset[s] + header->bytes[s] > size)
+                return release();
+            checksum = tspbin_section_checksum(checksum, s, section(s), header->bytes[s]);
+        }
+        if (checksum != header->checksum)
+        {
+            fprintf(stderr, "%s: checksum mismatch, ignoring cache\n", path);
+            return release();
+        }
+        madvise(map, size, MADV_WILLNEED);
+        return true;
+    }
+
+    bool mapped() const
+    {
+        return header != NULL;
+    }
+
+    // Unmaps the file; returns false so failed checks can return release().
+    bool release()
+    {
+        if (map != NULL)
+            munmap(map, size);
+        map = NULL;
+        header = NULL;
+        return false;
+    }
+
+    // The instance, copied out of the mapping on purpose: callers own it and
+    // may renumber it. That copies the coordinates and ids, and the EXPLICIT
+    // weights if any; the distance table is used in place through matrix().
+    TspInstance instance() const
+    {
+        TspInstance instance;
+        instance.name = header->name;
+        instance.edge_weight_type = header->edge_weight_type;
+        instance.curve = header->curve;
+        instance.weight_type = (EdgeWeight)header->weight_type;
+        instance.weight_format = (WeightFormat)header->weight_format;
+        instance.dimension = header->dimension;
+        const double *x = (const double *)section(SectionX);
+        const double *y = (const double *)section(SectionY);
+        const double *w = (const double *)section(SectionWeights);
+        const int *ids = (const int *)section(SectionIds);
+        instance.x.assign(x, x + header->bytes[SectionX] / sizeof(double));
+        instance.y.assign(y, y + header->bytes[SectionY] / sizeof(double));
+        instance.weights.assign(w, w + header->bytes[SectionWeights] / sizeof(double));
+        instance.ids.assign(ids, ids + header->bytes[SectionIds] / sizeof(int));
+        return instance;
+    }
+
+    // The cached table when it was stored with layout L and entries of type T.
+    template <typename T, MatrixLayout L>
+    const T *matrix() const
+    {
+        if (header == NULL || header->matrix_layout != (int)L || header->matrix_entry != sizeof(T) ||
+            header->bytes[SectionMatrix] == 0)
+            return NULL;
+        return (const T *)section(SectionMatrix);
+    }
+
+    // The cached candidate lists when they were built with the same k.
+    bool candidates(int k, CandidateLists *lists) const
+    {
+        if (header == NULL || header->neighbors != k || header->bytes[SectionNeighbors] == 0)
+            return false;
+        int n = header->dimension;
+        const int32_t *p = (const int32_t *)section(SectionNeighbors);
+        *lists = CandidateLists(n, k);
+        lists->offset.assign(p, p + n + 1);
+        lists->list.assign(p + n + 1, p + n + 1 + lists->offset[n]);
+        return true;
+    }
+
+    // Rewrites the cache from a freshly built instance (and table, if any).
+    // The file is written aside and renamed, so running processes keep the
+    // mapping they have.
+    void store(const TspInstance &instance, const void *table, size_t table_bytes, int layout, int entry)
+    {
+        if (target.empty())
+            return;
+        TspBinHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, tspbin_magic, sizeof(tspbin_magic));
+        if (!source.empty() && !tspbin_source(source.c_str(), &h.source_size, &h.source_mtime))
+            return;
+        strncpy(h.name, instance.name.c_str(), sizeof(h.name) - 1);
+        strncpy(h.edge_weight_type, instance.edge_weight_type.c_str(), sizeof(h.edge_weight_type) - 1);
+        strncpy(h.curve, instance.curve.c_str(), sizeof(h.curve) - 1);
+        h.weight_type = (int32_t)instance.weight_type;
+        h.weight_format = (int32_t)instance.weight_format;
+        h.dimension = instance.dimension;
+        h.matrix_layout = table != NULL ? layout : -1;
+        h.matrix_entry = table != NULL ? entry : 0;
+        std::vector<int32_t> csr;
+        if (neighbors != NULL && neighbors->nearest() > 0)
+        {
+            h.neighbors = neighbors->nearest();
+            csr = neighbors->offset;
+            csr.insert(csr.end(), neighbors->list.begin(), neighbors->list.end());
+        }
+        const void *data[SectionCount] = {instance.x.data(), instance.y.data(), instance.weights.data(), table,
+                                          csr.data(), instance.ids.data()};
+        h.bytes[SectionX] = instance.x.size() * sizeof(double);
+        h.bytes[SectionY] = instance.y.size() * sizeof(double);
+        h.bytes[SectionWeights] = instance.weights.size() * sizeof(double);
+        h.bytes[SectionMatrix] = table != NULL ? table_bytes : 0;
+        h.bytes[SectionNeighbors] = csr.size() * sizeof(int32_t);
+        h.bytes[SectionIds] = instance.ids.size() * sizeof(int);
+        uint64_t offset = tspbin_align;
+        for (int s = 0; s < SectionCount; s++)
+        {
+            h.offset[s] = offset;
+            offset += (h.bytes[s] + tspbin_align - 1) / tspbin_align * tspbin_align;
+        }
+        uint64_t checksum = tspbin_checksum(0xcbf29ce484222325ULL, &h, sizeof(h));
+        for (int s = 0; s < SectionCount; s++)
+            checksum = tspbin_section_checksum(checksum, s, data[s], h.bytes[s]);
+        h.checksum = checksum;
+
+        std::string tmp = target + "." + std::to_string(getpid());
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+        for (int s = 0; s < SectionCount && ok; s++)
+        {
+            const char *p = (const char *)data[s];
+            for (uint64_t done = 0; done < h.bytes[s] && ok;)
+            {
+                ssize_t w = pwrite(fd, p + done, h.bytes[s] - done, h.offset[s] + done);
+                ok = w > 0;
+                done += ok ? w : 0;
+            }
+        }
+        ok = ok && ftruncate(fd, offset) == 0;
+        if (fd >= 0)
+            close(fd);
+        if (!ok || rename(tmp.c_str(), target.c_str()) != 0)
+        {
+            fprintf(stderr, "%s: cannot write cache\n", target.c_str());
+            unlink(tmp.c_str());
+            return;
+        }
+        std::cout << "CACHE: wrote " << target << " (" << offset << " bytes)" << std::endl;
+    }
+
+    // Where store() writes and the .tsp it checks freshness against; an empty
+    // target makes the cache read-only, an empty source writes a standalone
+    // .tspbin.
+    std::string target;
+    std::string source;
+    // Candidate lists store() writes along, if any.
+    const CandidateLists *neighbors = NULL;
+
+private:
+    const void *section(int s) const
+    {
+        return (const char *)map + header->offset[s];
+    }
+
+    void *map = NULL;
+    size_t size = 0;
+    const TspBinHeader *header = NULL;
+};
+
+// Loads an instance and renumbers it as --reorder asks. A .tspbin path is
+// mapped directly and keeps its numbering. With --cache, a fresh
+// <file>.tspbin with the same numbering is used in place of parsing
+// file_path; a missing or stale one is rewritten once the distances have been
+// built.
+static inline TspInstance load_instance(const char *file_path, const GaOptions &options, int nw, TspCache *cache)
+{
+    size_t len = strlen(file_path);
+    if (len > 7 && strcmp(file_path + len - 7, ".tspbin") == 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!cache->map_file(file_path, NULL))
+            tsp_load_error(file_path, "invalid or corrupt .tspbin file");
+        TspInstance instance = cache->instance();
+        struct stat st;
+        stat(file_path, &st);
+        tsp_report(instance, st.st_size, start);
+        return instance;
+    }
+    if (options.cache)
+    {
+        cache->target = std::string(file_path) + ".tspbin";
+        cache->source = file_path;
+        auto start = std::chrono::steady_clock::now();
+        if (cache->map_file(cache->target.c_str(), file_path))
+        {
+            TspInstance instance = cache->instance();
+            if (instance.curve == options.reorder || instance.x.empty())
+            {
+                struct stat st;
+                stat(cache->target.c_str(), &st);
+                tsp_report(instance, st.st_size, start);
+                return instance;
+            }
+            cache->release();
+        }
+    }
+    TspInstance instance = load_tsp(file_path, nw);
+    curve_renumber(instance, options.reorder);
+    return instance;
+}
+
+// Fills lists with the --neighbors candidate lists, from the cache when it
+// holds them, and hands them to the cache for the next store().
+static inline void load_candidates(const TspInstance &instance, const GaOptions &options, int nw, TspCache *cache,
+                                   CandidateLists *lists)
+{
+    if (!cache->candidates(options.neighbors, lists))
+        *lists = build_candidates(instance, options.neighbors, nw);
+    cache->neighbors = lists;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include "tsp_loader.hpp"
+#include "tsp_cache.hpp"
+
+using namespace std;
+
+// Synthetic EUC_2D instances for scaling runs, in the style of the DIMACS
+// TSP challenge generators: integer coordinates in [0, 1e6). Cities are made
+// in blocks whose random streams depend only on the seed and the block
+// index, so an instance is the same whatever the number of threads.
+
+static const int gen_block = 1 << 16;
+static const double gen_side = 1000000;
+
+struct Generator
+{
+    const char *kind;
+    int n;
+    unsigned seed;
+    vector<double> center_x, center_y;
+    double sigma = 0;
+    int columns = 0;
+
+    Generator(const char *kind, int n, unsigned seed) : kind(kind), n(n), seed(seed)
+    {
+        if (strcmp(kind, "clustered") == 0)
+        {
+            // dsj-style: n / 100 centres, normal spread scaled to the cluster size.
+            int clusters = max(1, n / 100);
+            mt19937_64 rng(seed);
+            uniform_real_distribution<double> pos(0, gen_side);
+            for (int c = 0; c < clusters; c++)
+            {
+                center_x.push_back(pos(rng));
+                center_y.push_back(pos(rng));
+            }
+            sigma = gen_side / sqrt((double)n);
+        }
+        else if (strcmp(kind, "grid") == 0)
+        {
+            columns = (int)ceil(sqrt((double)n));
+        }
+    }
+
+    void block(int b, double *x, double *y) const
+    {
+        seed_seq seq{seed, (unsigned)b};
+        mt19937_64 rng(seq);
+        uniform_real_distribution<double> pos(0, gen_side);
+        normal_distribution<double> spread(0, sigma > 0 ? sigma : 1);
+        uniform_int_distribution<int> cluster(0, max(0, (int)center_x.size() - 1));
+        int begin = b * gen_block;
+        int end = min(n, begin + gen_block);
+        for (int i = begin; i < end; i++)
+        {
+            if (columns > 0)
+            {
+                double step = gen_side / columns;
+                x[i] = (i % columns) * step;
+                y[i] = (i / columns) * step;
+            }
+            else if (sigma > 0)
+            {
+                int c = cluster(rng);
+                x[i] = center_x[c] + spread(rng);
+                y[i] = center_y[c] + spread(rng);
+            }
+            else
+            {
+                x[i] = pos(rng);
+                y[i] = pos(rng);
+            }
+            x[i] = floor(min(max(x[i], 0.0), gen_side - 1));
+            y[i] = floor(min(max(y[i], 0.0), gen_side - 1));
+        }
+    }
+};
+
+// Formats one block of NODE_COORD_SECTION lines.
+static void format_block(const TspInstance &instance, int b, string *out)
+{
+    char line[64];
+    int begin = b * gen_block;
+    int end = min(instance.dimension, begin + gen_block);
+    out->reserve((size_t)(end - begin) * 24);
+    for (int i = begin; i < end; i++)
+    {
+        int len = snprintf(line, sizeof(line), "%d %.0f %.0f\n", i + 1, instance.x[i], instance.y[i]);
+        out->append(line, len);
+    }
+}
+
+static void write_tsp(const TspInstance &instance, const char *path, int nw)
+{
+    int blocks = (instance.dimension + gen_block - 1) / gen_block;
+    vector<string> text(blocks);
+    vector<thread> writers;
+    for (int t = 0; t < nw; t++)
+        writers.push_back(thread([&, t]()
+                                 {
+                                     for (int b = t; b < blocks; b += nw)
+                                         format_block(instance, b, &text[b]);
+                                 }));
+    for (auto &t : writers)
+        t.join();
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "NAME: %s\nCOMMENT: generated by tsp_gen\nTYPE: TSP\nDIMENSION: %d\nEDGE_WEIGHT_TYPE: EUC_2D\n",
+            instance.name.c_str(), instance.dimension);
+    fprintf(f, "NODE_COORD_SECTION\n");
+    for (const string &s : text)
+        fwrite(s.data(), 1, s.size(), f);
+    fprintf(f, "EOF\n");
+    if (fclose(f) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        printf("Usage: tsp_gen <uniform|clustered|grid> <cities> <out.tsp|out.tspbin> [seed] [nw]\n");
+        exit(0);
+    }
+    const char *kind = argv[1];
+    if (strcmp(kind, "uniform") != 0 && strcmp(kind, "clustered") != 0 && strcmp(kind, "grid") != 0)
+    {
+        fprintf(stderr, "unknown instance kind '%s'\n", kind);
+        exit(1);
+    }
+    int n = stoi(argv[2]);
+    const char *path = argv[3];
+    unsigned seed = argc > 4 ? stoul(argv[4]) : 1;
+    int nw = argc > 5 ? stoi(argv[5]) : (int)thread::hardware_concurrency();
+    if (n < 3)
+    {
+        fprintf(stderr, "need at least 3 cities\n");
+        exit(1);
+    }
+    nw = max(1, nw);
+
+    auto start = chrono::steady_clock::now();
+    Generator gen(kind, n, seed);
+    TspInstance instance;
+    instance.name = string(kind == string("clustered") ? "C" : kind == string("grid") ? "G" : "E") + to_string(n) + "s" +
+                    to_string(seed);
+    instance.edge_weight_type = "EUC_2D";
+    instance.weight_type = EdgeWeight::Euc2D;
+    instance.dimension = n;
+    instance.x.resize(n);
+    instance.y.resize(n);
+    int blocks = (n + gen_block - 1) / gen_block;
+    vector<thread> makers;
+    for (int t = 0; t < nw; t++)
+        makers.push_back(thread([&, t]()
+                                {
+                                    for (int b = t; b < blocks; b += nw)
+                                        gen.block(b, instance.x.data(), instance.y.data());
+                                }));
+    for (auto &t : makers)
+        t.join();
+
+    size_t len = strlen(path);
+    if (len > 7 && strcmp(path + len - 7, ".tspbin") == 0)
+    {
+        TspCache cache;
+        cache.target = path;
+        cache.store(instance, NULL, 0, 0, 0);
+    }
+    else
+    {
+        write_tsp(instance, path, nw);
+    }
+    long usec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    cout << "GEN: " << instance.name << ", " << n << " cities in " << usec << " usec" << endl;
+}
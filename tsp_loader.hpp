@@ -0,0 +1,394 @@
+#ifndef TSP_LOADER_HPP
+#define TSP_LOADER_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <iostream>
+
+enum class EdgeWeight
+{
+    Euc2D,
+    Ceil2D,
+    Att,
+    Geo,
+    Man2D,
+    Explicit
+};
+
+enum class WeightFormat
+{
+    None,
+    FullMatrix,
+    UpperRow,
+    LowerRow,
+    UpperDiagRow,
+    LowerDiagRow
+};
+
+// Coordinates are kept as read from the file; EXPLICIT instances carry the
+// EDGE_WEIGHT_SECTION values in file order instead. When the cities have been
+// renumbered along a space-filling curve, ids holds the file id of each city.
+struct TspInstance
+{
+    std::string name;
+    std::string edge_weight_type;
+    EdgeWeight weight_type = EdgeWeight::Euc2D;
+    WeightFormat weight_format = WeightFormat::None;
+    int dimension = 0;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> weights;
+    std::vector<int> ids;
+    std::string curve = "none";
+};
+
+static void tsp_load_error(const char *file_path, const char *what)
+{
+    fprintf(stderr, "%s: %s\n", file_path, what);
+    exit(1);
+}
+
+static inline bool tsp_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char *tsp_skip_spaces(const char *p, const char *end)
+{
+    while (p < end && tsp_is_space(*p))
+        p++;
+    return p;
+}
+
+static inline const char *tsp_next_line(const char *p, const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+// Parses an integer or a decimal number (optional exponent) starting at p;
+// returns the position after the last consumed character, or p on failure.
+static inline const char *tsp_scan_number(const char *p, const char *end, double *value)
+{
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                   1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    while (p < end && (unsigned)(*p - '0') < 10)
+    {
+        if (digits < 18)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+        }
+        else
+        {
+            scale++;
+        }
+        p++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10)
+        {
+            if (digits < 18)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+                scale--;
+            }
+            p++;
+        }
+    }
+    if (p == start || (p - start == 1 && (*start == '-' || *start == '+' || *start == '.')))
+        return start;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool exp_negative = false;
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            exp_negative = *q == '-';
+            q++;
+        }
+        int exponent = 0;
+        const char *exp_start = q;
+        while (q < end && (unsigned)(*q - '0') < 10)
+        {
+            exponent = exponent * 10 + (*q - '0');
+            q++;
+        }
+        if (q != exp_start)
+        {
+            scale += exp_negative ? -exponent : exponent;
+            p = q;
+        }
+    }
+    double v = (double)mantissa;
+    while (scale > 18)
+    {
+        v *= pow10[18];
+        scale -= 18;
+    }
+    while (scale < -18)
+    {
+        v /= pow10[18];
+        scale += 18;
+    }
+    v = scale >= 0 ? v * pow10[scale] : v / pow10[-scale];
+    *value = negative ? -v : v;
+    return p;
+}
+
+// Parses "id x y" lines in [begin, end); a line belongs to the chunk in which it starts.
+static long tsp_parse_coords(const char *begin, const char *end, const char *limit, TspInstance *instance, std::atomic<bool> *bad)
+{
+    long parsed = 0;
+    const char *p = begin;
+    while (p < end)
+    {
+        const char *line_end = tsp_next_line(p, limit);
+        const char *q = tsp_skip_spaces(p, line_end);
+        if (q < line_end && *q != '\n')
+        {
+            double id = 0, x = 0, y = 0;
+            const char *r = tsp_scan_number(q, line_end, &id);
+            r = tsp_skip_spaces(r, line_end);
+            const char *s = tsp_scan_number(r, line_end, &x);
+            s = tsp_skip_spaces(s, line_end);
+            const char *t = tsp_scan_number(s, line_end, &y);
+            int idx = (int)id - 1;
+            if (r == q || s == r || t == s || idx < 0 || idx >= instance->dimension)
+            {
+                *bad = true;
+                return parsed;
+            }
+            instance->x[idx] = x;
+            instance->y[idx] = y;
+            parsed++;
+        }
+        p = line_end;
+    }
+    return parsed;
+}
+
+static void tsp_report(const TspInstance &instance, size_t size, std::chrono::steady_clock::time_point start)
+{
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "LOAD: " << instance.name << " (" << instance.edge_weight_type << "), " << instance.dimension << " cities, "
+              << size << " bytes in " << (long)(secs * 1e6) << " usec (" << size / secs / 1e6 << " MB/s, "
+              << instance.dimension / secs << " cities/s)" << std::endl;
+}
+
+static bool tsp_edge_weight(const std::string &type, EdgeWeight *weight)
+{
+    static const struct
+    {
+        const char *name;
+        EdgeWeight weight;
+    } types[] = {{"EUC_2D", EdgeWeight::Euc2D}, {"CEIL_2D", EdgeWeight::Ceil2D}, {"ATT", EdgeWeight::Att},
+                 {"GEO", EdgeWeight::Geo}, {"MAN_2D", EdgeWeight::Man2D}, {"EXPLICIT", EdgeWeight::Explicit}};
+    for (auto &t : types)
+    {
+        if (type == t.name)
+        {
+            *weight = t.weight;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool tsp_weight_format(const std::string &format, WeightFormat *weight_format)
+{
+    static const struct
+    {
+        const char *name;
+        WeightFormat format;
+    } formats[] = {{"FULL_MATRIX", WeightFormat::FullMatrix}, {"UPPER_ROW", WeightFormat::UpperRow},
+                   {"LOWER_ROW", WeightFormat::LowerRow}, {"UPPER_DIAG_ROW", WeightFormat::UpperDiagRow},
+                   {"LOWER_DIAG_ROW", WeightFormat::LowerDiagRow}};
+    for (auto &f : formats)
+    {
+        if (format == f.name)
+        {
+            *weight_format = f.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t tsp_weight_count(WeightFormat format, size_t n)
+{
+    switch (format)
+    {
+    case WeightFormat::FullMatrix:
+        return n * n;
+    case WeightFormat::UpperRow:
+    case WeightFormat::LowerRow:
+        return n * (n - 1) / 2;
+    case WeightFormat::UpperDiagRow:
+    case WeightFormat::LowerDiagRow:
+        return n * (n + 1) / 2;
+    default:
+        return 0;
+    }
+}
+
+static void tsp_parse_weights(const char *file_path, const char *p, const char *end, TspInstance *instance)
+{
+    size_t count = tsp_weight_count(instance->weight_format, instance->dimension);
+    instance->weights.resize(count);
+    for (size_t k = 0; k < count; k++)
+    {
+        while (p < end && (tsp_is_space(*p) || *p == '\n'))
+            p++;
+        const char *q = tsp_scan_number(p, end, &instance->weights[k]);
+        if (q == p)
+            tsp_load_error(file_path, "EDGE_WEIGHT_SECTION does not match DIMENSION and EDGE_WEIGHT_FORMAT");
+        p = q;
+    }
+}
+
+static TspInstance load_tsp(const char *file_path, int nw)
+{
+    auto start = std::chrono::steady_clock::now();
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+        tsp_load_error(file_path, "cannot open file");
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+        tsp_load_error(file_path, "cannot stat file or file is empty");
+    size_t size = st.st_size;
+    const char *data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        tsp_load_error(file_path, "cannot map file");
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+    const char *end = data + size;
+
+    TspInstance instance;
+    const char *p = data;
+    const char *section = NULL;
+    std::string section_name;
+    std::string weight_format;
+    while (p < end && section == NULL)
+    {
+        const char *line_end = tsp_next_line(p, end);
+        const char *key = tsp_skip_spaces(p, line_end);
+        const char *key_end = key;
+        while (key_end < line_end && *key_end != ':' && !tsp_is_space(*key_end) && *key_end != '\n')
+            key_end++;
+        std::string k(key, key_end);
+        const char *value = key_end;
+        while (value < line_end && (tsp_is_space(*value) || *value == ':'))
+            value++;
+        const char *value_end = line_end;
+        while (value_end > value && (tsp_is_space(value_end[-1]) || value_end[-1] == '\n'))
+            value_end--;
+        if (k == "NODE_COORD_SECTION" || k == "EDGE_WEIGHT_SECTION")
+        {
+            section = line_end;
+            section_name = k;
+        }
+        else if (k == "EOF")
+            break;
+        else if (k == "NAME")
+            instance.name.assign(value, value_end);
+        else if (k == "EDGE_WEIGHT_TYPE")
+            instance.edge_weight_type.assign(value, value_end);
+        else if (k == "EDGE_WEIGHT_FORMAT")
+            weight_format.assign(value, value_end);
+        else if (k == "DIMENSION")
+        {
+            double dimension = 0;
+            tsp_scan_number(value, value_end, &dimension);
+            instance.dimension = (int)dimension;
+        }
+        p = line_end;
+    }
+    if (instance.dimension <= 0)
+        tsp_load_error(file_path, "missing or invalid DIMENSION");
+    if (!tsp_edge_weight(instance.edge_weight_type, &instance.weight_type))
+        tsp_load_error(file_path, "missing or unsupported EDGE_WEIGHT_TYPE");
+    if (instance.weight_type == EdgeWeight::Explicit)
+    {
+        if (!tsp_weight_format(weight_format, &instance.weight_format))
+            tsp_load_error(file_path, "missing or unsupported EDGE_WEIGHT_FORMAT");
+        if (section_name != "EDGE_WEIGHT_SECTION")
+            tsp_load_error(file_path, "missing EDGE_WEIGHT_SECTION");
+        tsp_parse_weights(file_path, section, end, &instance);
+        munmap((void *)data, size);
+        tsp_report(instance, size, start);
+        return instance;
+    }
+    if (section_name != "NODE_COORD_SECTION")
+        tsp_load_error(file_path, "missing NODE_COORD_SECTION");
+
+    // The coordinate block ends at the first line starting with a keyword (EOF or another section).
+    const char *section_end = section;
+    while (section_end < end)
+    {
+        const char *q = tsp_skip_spaces(section_end, end);
+        if (q < end && ((*q >= 'A' && *q <= 'Z') || (*q >= 'a' && *q <= 'z')))
+            break;
+        section_end = tsp_next_line(section_end, end);
+    }
+
+    instance.x.resize(instance.dimension);
+    instance.y.resize(instance.dimension);
+    int nt = nw < 1 ? 1 : nw;
+    size_t block = section_end - section;
+    if (block < (size_t)nt * 4096)
+        nt = 1;
+    std::vector<const char *> bounds(nt + 1);
+    bounds[0] = section;
+    bounds[nt] = section_end;
+    for (int t = 1; t < nt; t++)
+    {
+        const char *b = section + block / nt * t;
+        bounds[t] = b == section ? b : tsp_next_line(b - 1, section_end);
+    }
+    std::vector<long> counts(nt, 0);
+    std::atomic<bool> bad(false);
+    std::vector<std::thread> loaders;
+    for (int t = 1; t < nt; t++)
+        loaders.push_back(std::thread([&, t]()
+                                      { counts[t] = tsp_parse_coords(bounds[t], bounds[t + 1], section_end, &instance, &bad); }));
+    counts[0] = tsp_parse_coords(bounds[0], bounds[1], section_end, &instance, &bad);
+    for (auto &t : loaders)
+        t.join();
+    long parsed = 0;
+    for (long c : counts)
+        parsed += c;
+    munmap((void *)data, size);
+    if (bad)
+        tsp_load_error(file_path, "malformed line in NODE_COORD_SECTION");
+    if (parsed != instance.dimension)
+        tsp_load_error(file_path, "NODE_COORD_SECTION does not match DIMENSION");
+
+    tsp_report(instance, size, start);
+    return instance;
+}
+
+#endif